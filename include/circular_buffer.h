@@ -17,8 +17,14 @@ typedef struct {
 }
 DataPoint;
 
+//
+// Stored column-wise: one x column and exactly y_count y columns of sz values each,
+// y column j starting at y + j * sz. head, tail and cb_index() give positions
+// within the columns.
+//
 typedef struct {
-    DATA_TYPE *buffer;
+    double *x;
+    CB_Y_TYPE *y;
     size_t head;
     size_t tail;
     size_t sz;
@@ -26,15 +32,29 @@ typedef struct {
     size_t y_count;
 } CircularBuffer;
 
-void cb_init(CircularBuffer *cb, size_t y_count, size_t size);
+//
+// A run of len consecutive positions starting at idx, valid in every column
+//
+typedef struct {
+    size_t idx;
+    size_t len;
+} CbSpan;
+
+bool cb_init(CircularBuffer *cb, size_t y_count, size_t size);
 void cb_free(CircularBuffer *cb);
 bool cb_push(CircularBuffer *cb, DATA_TYPE item);
 bool cb_pull(CircularBuffer *cb, DATA_TYPE *item);
+size_t cb_push_n(CircularBuffer *cb, const double *x, const double *const *y, size_t n);
+size_t cb_pull_n(CircularBuffer *cb, double *x, double *const *y, size_t n);
+int cb_view(CircularBuffer *cb, size_t first, size_t n, CbSpan span[2]);
 bool cb_empty(CircularBuffer *cb);
 bool cb_full(CircularBuffer *cb); 
 int cb_peek_head(CircularBuffer *cb, int curr_head, DATA_TYPE *item); 
 int cb_peek_tail(CircularBuffer *cb, int curr_tail, DATA_TYPE *item); 
 size_t cb_count(CircularBuffer *cb);
+size_t cb_index(CircularBuffer *cb, size_t i);
+CB_Y_TYPE *cb_y(CircularBuffer *cb, size_t j);
+size_t cb_lower_bound(CircularBuffer *cb, double x);
 void cb_print(CircularBuffer *cb); 
 
 #endif
@@ -13,14 +13,40 @@
 
 #define DATA_TYPE               	DataPoint
 #define MAX_Y_PLOTS             	8
-#define MAX_WINDOWS             	8       
+#define MAX_WINDOWS             	512
 #define MAX_STR_LEN             	64   
 #define MAX_JSON_LEN            	1024   
+#define MAX_JSON_NUM_LEN                32      // longest number RTPS_put_json_number() writes
 #define MAX_POINTS			1024
+#define MAX_WINDOW_POINTS               (4 * 1024 * 1024)       // largest x_range / x_step
+#define RX_CHUNK_LEN                    65536
+#define DEFAULT_FRAME_RATE              60
+#define EVENT_QUEUE_LEN                 (4 * 1024 * 1024)
+#define EVENT_MAX_POINTS                1024
+#define INGEST_POLL_MS                  100
+#define MAX_CLIENTS                     256
+#define CLIENT_QUEUE_LEN                (1024 * 1024)   // default async send queue
+#define CLIENT_TX_LEN                   (256 * 1024)    // bytes gathered per write
+#define CLIENT_TX_IDLE_US               1000            // sender sleep with nothing queued
+#define UNIX_PACKET_LEN                 (192 * 1024)    // largest message on "unixpacket:"
+#define UDP_RECV_BATCH                  64              // datagrams per recvmmsg()
+#define UDP_REORDER_LIMIT               1024            // older sequence numbers restart the count
+#define CLIENT_SHM_LEN                  (4 * 1024 * 1024)       // default shared-memory ring
+
+// Storage type of buffered y values; float halves their memory
+#ifndef CB_Y_TYPE
+#define CB_Y_TYPE                       double
+#endif
+
+// Round buffer sizes up to a power of two so positions wrap with a mask
+//#define CB_POW2
 
 #define PLOT_MARGIN_LEFT                60
 #define PLOT_MARGIN_RIGHT               20
 #define PLOT_MARGIN_TOP                 60
 #define PLOT_MARGIN_BOTTOM              60
+#define PLOT_LINE_WIDTH                 2
+#define PLOT_LABEL_PAD                  10      // x label overhang left of its grid line
+#define PLOT_XFORM_CHUNK                256     // points transformed per pass in draw_plot()
 
 #endif  // __GLOBAL_H__
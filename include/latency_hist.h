@@ -0,0 +1,39 @@
+/*!
+ *---------------------------------------------------------------------------
+ *
+ * @file	latency_hist.h
+ *
+ * @brief	Lock-free log-linear latency histogram header file
+ *
+ *---------------------------------------------------------------------------
+ */
+#ifndef __LATENCY_HIST_H__
+#define __LATENCY_HIST_H__
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LH_SUB_BITS             5       // 32 buckets per power of two, within 3%
+#define LH_MAX_BITS             36      // values from 2^36 ns (about 69 s) share the last bucket
+#define LH_BUCKETS              ((LH_MAX_BITS - LH_SUB_BITS + 1) << LH_SUB_BITS)
+
+//
+// HDR-style histogram of nanosecond values: exact below 2^LH_SUB_BITS,
+// then LH_SUB_BITS bits of precision per power of two. Any thread may record
+// into it and any thread may read it; counts are relaxed atomics, so a reader
+// sees each one whole but not always every count of an in-flight record.
+// Percentiles can be taken over everything recorded or over what was added
+// since an earlier lh_snapshot().
+//
+typedef struct {
+    atomic_ulong count[LH_BUCKETS];
+    atomic_ulong total;
+    atomic_ulong max;
+} LatencyHist;
+
+void lh_record(LatencyHist *h, uint64_t ns, unsigned long n);
+void lh_snapshot(const LatencyHist *h, LatencyHist *copy);
+unsigned long lh_count(const LatencyHist *h, const LatencyHist *since);
+uint64_t lh_percentile(const LatencyHist *h, const LatencyHist *since, double p);
+
+#endif
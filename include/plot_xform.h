@@ -0,0 +1,31 @@
+/*!
+ *---------------------------------------------------------------------------
+ *
+ * @file	plot_xform.h
+ *
+ * @brief	Data to pixel transform kernels header file
+ *
+ *---------------------------------------------------------------------------
+ */
+#ifndef __PLOT_XFORM_H__
+#define __PLOT_XFORM_H__
+#include <stddef.h>
+#include <stdint.h>
+#include <global.h>
+
+//
+// Map columns of data to pixel coordinates in one pass. Uses AVX2 when built
+// with -mavx2, SSE2 on any other x86-64 build and plain C elsewhere; all
+// three give the same results. Results are clamped to +/-XFORM_PX_LIMIT;
+// xform_y() maps NaN, a gap in the data, to XFORM_PX_GAP.
+//
+#define XFORM_PX_LIMIT          (1 << 24)
+#define XFORM_PX_GAP            INT32_MIN
+
+void xform_x(const double *x, size_t n, double scale, double origin, int left, int *px);
+size_t xform_y(const CB_Y_TYPE *y, size_t n, double y_max, double scale, int top, int *py);
+void xform_minmax(const CB_Y_TYPE *y, size_t n, double *min, double *max);
+void xform_minmax_i(const int *v, size_t n, int *min, int *max);
+const char *xform_isa(void);
+
+#endif
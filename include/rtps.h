@@ -13,15 +13,68 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
 #include <cjson/cJSON.h>
 #include <global.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
 #include <circular_buffer.h>
+#include <spsc_ring.h>
+#include <plot_xform.h>
+#include <latency_hist.h>
+#include <rtps_proto.h>
+
+
+typedef struct {
+   uint8_t *buf;
+   size_t len;
+   size_t cap;
+}
+RTPS_RxBuffer;
+
+
+typedef struct {
+   uint8_t *buf;
+   size_t len;
+   size_t cap;
+}
+RTPS_TxBuffer;
+
+
+typedef struct {
+   unsigned long queued;        // points accepted into the send queue
+   unsigned long sent;          // points written to the socket
+   unsigned long dropped;       // points refused because the queue was full
+   unsigned long blocked;       // times the socket could not take more data
+}
+RTPS_ClientStats;
+
+
+typedef struct {
+   SpscRing *queue;             // encoded points, caller -> sender
+   RTPS_TxBuffer tx;            // frames being written, tx_off..tx.len still pending
+   size_t tx_off;
+   unsigned long tx_points;     // points in the pending frames
+   DataPoint *rows;             // points of one JSON message
+   size_t rows_cap;
+   bool threaded;
+   pthread_t thread;
+   atomic_bool running;
+   atomic_bool busy;            // sender holds data taken from the queue
+   atomic_bool failed;          // the connection broke; nothing more is sent
+   atomic_ulong queued;
+   atomic_ulong sent;
+   atomic_ulong dropped;
+   atomic_ulong blocked;
+}
+RTPS_ClientAsync;
 
 
 typedef struct {
@@ -30,19 +83,71 @@ typedef struct {
    int port;
    int client;
    bool connected;
+   int encoding;
+   int req_encoding;
    struct sockaddr_in address;
+   RTPS_TxBuffer tx;            // message being encoded, reused for every send
+   RTPS_ClientAsync *async;     // NULL unless RTPS_client_start_async() was called
+   int udp_fd;                  // -1 unless RTPS_client_enable_udp() was called
+   int type;                    // SOCK_STREAM, or SOCK_SEQPACKET for "unixpacket:"
+   size_t max_msg;              // largest single write the socket takes
+   bool listening;
+   struct sockaddr_un unix_address;     // "unix:" endpoints; sun_family is 0 otherwise
+   bool stamp;                  // RTPS_client_set_timestamps()
 }
 RTPS_Connection;
 
 
+typedef struct {
+   int fd;
+   bool packet;                 // SOCK_SEQPACKET: every read is whole frames
+   RTPS_RxBuffer rx;            // partial messages awaiting the rest of their bytes
+   bool broken;                 // a reply was cut short; dropped after this message
+}
+RTPS_Client;
+
+
 typedef struct {
    int r, g, b, a;
 }
 RTPS_Color;
 
 
+// Stages of a timestamped batch, each measured from the client's send time
+#define RTPS_STAGE_RECV         0       // read from the socket
+#define RTPS_STAGE_PARSE        1       // decoded
+#define RTPS_STAGE_QUEUE        2       // handed to the render thread
+#define RTPS_STAGE_PRESENT      3       // on screen, after SDL_RenderPresent()
+#define RTPS_STAGES             4
+
+typedef struct {
+   LatencyHist stage[RTPS_STAGES];      // samples, weighted by points per batch
+   LatencyHist shown;           // render thread: stage[RTPS_STAGE_PRESENT] at the last overlay update
+   uint64_t shown_ns;
+   char text[MAX_STR_LEN];      // overlay readout
+}
+RTPS_Latency;
+
+typedef struct {
+   uint64_t sent_ns;
+   uint32_t count;
+}
+RTPS_Stamp;
+
+typedef struct {
+   unsigned long count;
+   uint64_t p50_ns;
+   uint64_t p99_ns;
+   uint64_t p999_ns;
+   uint64_t max_ns;
+}
+RTPS_LatencyStats;
+
+
 typedef struct {
 //   char name[MAX_STR_LEN];
+   int id;                      // handle assigned by the server on "create"
+   uint32_t gen;                // server: RTPS_WindowSlot generation it was created as
    char title[MAX_STR_LEN];
    char x_label[MAX_STR_LEN];
    char y_label[MAX_STR_LEN];
@@ -58,12 +163,100 @@ typedef struct {
    double y_grid_step;
    SDL_Window *sdlwin;
    SDL_Renderer *sdlrendr;
+   SDL_Surface *surface;        // headless: what sdlrendr draws into, else NULL
    RTPS_Color y_color[MAX_Y_PLOTS];
    CircularBuffer cb;
+   SDL_Point *plot_pts;         // decimated vertices, y_count runs of plot_pts_stride
+   int plot_pts_stride;
+   SDL_Vertex *plot_verts;      // triangles of one thick series, 6 per segment
+   SDL_Texture *chrome;         // background, y grid, title and labels
+   SDL_Texture *xgrid;          // x grid lines and labels, starting at xgrid_start
+   double xgrid_start;
+   SDL_Texture *trace[2];       // plot area, scrolled by copying from one to the other
+   int trace_cur;
+   double trace_origin;         // pixel column of the left edge when last drawn
+   double trace_last_x;         // newest point already in the trace
+   bool trace_valid;
+   bool no_cache;               // renderer cannot draw to textures
+   bool dirty;
+   SpscRing *shm;               // shared-memory ring of plot data, or NULL
+   size_t shm_len;              // bytes mapped at shm
+   SpscReader shm_rd;           // server: read position in shm
+   uint32_t udp_seq;            // sequence number of the next datagram
+   uint64_t frame_count;        // times presented
+   uint64_t frame_ns;           // time the last redraw took
+   uint64_t next_dump_ns;
+   RTPS_Latency *latency;       // allocated by the ingest thread, freed with the window
+   RTPS_Stamp *stamps;          // timestamped batches applied but not yet presented
+   size_t stamp_count;
+   size_t stamp_cap;
 }
 RTPS_Window;
 
 
+typedef struct {
+   bool open;
+   uint32_t gen;                // "create" commands seen for this handle
+   int y_count;
+   bool udp_synced;             // udp_seq holds the next expected datagram
+   uint32_t udp_seq;
+   uint32_t udp_shed;           // datagrams shed for back-pressure since udp_seq
+   struct sockaddr_in udp_from; // sender of the sequence
+   RTPS_Latency *latency;
+}
+RTPS_WindowSlot;
+
+
+// Written by the render thread, read by "stats" on the ingest thread
+typedef struct {
+   atomic_ulong count;          // render passes that presented a window
+   atomic_ulong last_ns;        // time spent redrawing in the last one
+   atomic_ulong total_ns;
+   atomic_ulong max_ns;
+}
+RTPS_FrameStats;
+
+
+// A window's circular buffer as last seen by the render thread
+typedef struct {
+   atomic_ulong fill;           // points held
+   atomic_ulong capacity;
+   atomic_ulong overwrites;     // points pushed out by newer ones
+}
+RTPS_WindowGauge;
+
+
+typedef struct {
+   RTPS_Connection *conn;       // listener, owned by the ingest thread once started
+   RTPS_Window *win[MAX_WINDOWS];       // indexed by id, owned by the render (main) thread
+   SpscRing *queue;             // decoded events, ingest -> render
+   int epfd;
+   RTPS_Client *clients[MAX_CLIENTS];
+   int client_count;
+   pthread_t ingest;
+   atomic_bool running;
+   RTPS_WindowSlot slot[MAX_WINDOWS];   // ingest thread's view of the windows
+   bool dirty;                  // some window has data not yet presented
+   atomic_ulong queue_stalls;   // times ingest waited for the render thread
+   int udp_fd;                  // datagram socket on the listener's port, or -1
+   uint8_t *udp_buf;            // UDP_RECV_BATCH datagrams of RTPS_UDP_MAX_LEN
+   atomic_ulong udp_lost;       // datagrams missing from a window's sequence, as drawn
+   atomic_ulong udp_dropped;    // datagrams discarded: late, malformed or queue full
+   RTPS_FrameStats frames;      // render timing, kept by RTPS_server_render()
+   RTPS_WindowGauge gauge[MAX_WINDOWS];
+   atomic_uint open_failed[MAX_WINDOWS];        // generation the render thread could not open
+   RTPS_Latency *orphan[MAX_WINDOWS];   // render thread: latency of such a window until "destroy"
+   atomic_ulong open_errors;    // windows acknowledged but not opened
+   atomic_ulong overwrites;     // sum over all windows, including closed ones
+   atomic_ulong rx_messages;    // framed messages and datagrams read
+   atomic_ulong rx_bytes;
+   atomic_ulong rx_errors;      // messages that could not be parsed or applied
+   uint64_t rx_ns;              // ingest thread: when the message being decoded was read
+   uint64_t rx_sent_ns;         // ingest thread: its send timestamp, or 0
+}
+RTPS_Server;
+
+
 
 /*!
  *---------------------------------------------------------------------------------------
@@ -98,6 +291,11 @@ int RTPS_is_all_digits(const char *str);
  *
  *  @brief      Connect to a Real-Time Plot Server at <ipaddr:port>
  *
+ *  ipaddr may instead name a Unix domain socket on this host, "unix:/path" for a
+ *  stream or "unixpacket:/path" for a sequenced-packet socket; port is then unused.
+ *  Over "unixpacket:" a message is at most UNIX_PACKET_LEN bytes and, in async mode,
+ *  a send carries at most a fifth of that in binary rows; larger sends return -5.
+ *
  *  @param      ipaddr          IP address where the RTPS server is running
  *  @param      port            Port at which RTPS is listening
  *
@@ -121,6 +319,199 @@ void RTPS_disconnect(RTPS_Connection *conn);
 
 
 
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_set_encoding(RTPS_Connection *conn, int encoding)
+ *
+ *  @brief      Request an encoding for "plot" data
+ *
+ *  The request is sent with the next RTPS_client_create_plot() and only takes effect
+ *  if the server acknowledges it; until then data is sent as JSON.
+ *
+ *  @param      conn            RTPS_Connection
+ *  @param      encoding        RTPS_ENCODING_JSON or RTPS_ENCODING_BINARY
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_set_encoding(RTPS_Connection *conn, int encoding);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_set_timestamps(RTPS_Connection *conn, bool on)
+ *
+ *  @brief      Stamp every batch of "plot" data with its send time
+ *
+ *  The stamp is CLOCK_MONOTONIC, so the server's latency figures are only
+ *  meaningful when it runs on the same host. In async mode a batch is stamped
+ *  when it is queued.
+ *
+ *  @param      conn            RTPS_Connection
+ *  @param      on              true to stamp, false to stop
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_set_timestamps(RTPS_Connection *conn, bool on);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_start_async(RTPS_Connection *conn, size_t queue_len,
+ *                                          bool thread)
+ *
+ *  @brief      Queue "plot" data instead of sending it from the calling thread
+ *
+ *  Afterwards the send functions copy points into a bounded queue and return without
+ *  blocking; points that do not fit are dropped and counted. The queue is drained
+ *  into large writes either by a sender thread or by calling RTPS_client_poll().
+ *  Only one thread may call the send functions.
+ *
+ *  @param      conn            RTPS_Connection
+ *  @param      queue_len       Queue size in bytes; 0 for CLIENT_QUEUE_LEN
+ *  @param      thread          Start a sender thread rather than rely on polling
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_start_async(RTPS_Connection *conn, size_t queue_len, bool thread);
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_poll(RTPS_Connection *conn)
+ *
+ *  @brief      Write as much queued data as the socket takes, without blocking
+ *
+ *  @return     0 if everything was written; 1 if data remains; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_poll(RTPS_Connection *conn);
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_flush(RTPS_Connection *conn)
+ *
+ *  @brief      Block until all queued data is written
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_flush(RTPS_Connection *conn);
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_client_stop_async(RTPS_Connection *conn)
+ *
+ *  @brief      Flush the queue, stop the sender and go back to sending directly
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_client_stop_async(RTPS_Connection *conn);
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_get_stats(RTPS_Connection *conn, RTPS_ClientStats *stats)
+ *
+ *  @brief      Read the send queue counters
+ *
+ *  @return     0 if successful; negative if conn is not in async mode
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_get_stats(RTPS_Connection *conn, RTPS_ClientStats *stats);
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_enable_udp(RTPS_Connection *conn)
+ *
+ *  @brief      Send plot data as UDP datagrams to the server's port
+ *
+ *  For high-rate data where dropping samples beats falling behind. Points are
+ *  sent in binary, in datagrams of up to RTPS_UDP_MAX_LEN bytes, and are never
+ *  retransmitted; the server shows lost datagrams as gaps in the trace. Commands
+ *  still go over the stream connection.
+ *
+ *  @param      conn    RTPS_Connection
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_enable_udp(RTPS_Connection *conn);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_attach_shm(RTPS_Connection *conn, RTPS_Window *win, size_t len)
+ *
+ *  @brief      Send the plot data of a window through shared memory
+ *
+ *  Only for a server on the same host. Creates a ring of about len bytes (0 for
+ *  CLIENT_SHM_LEN) that the server maps and drains every frame. Afterwards the
+ *  send functions write win's points straight into the ring without a system
+ *  call and return -6 if it is full. Detached by RTPS_client_destroy_plot().
+ *
+ *  @param      conn    RTPS_Connection
+ *  @param      win     Window created with RTPS_client_create_plot()
+ *  @param      len     Ring size in bytes, or 0
+ *
+ *  @return     0 if the server attached the ring; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_attach_shm(RTPS_Connection *conn, RTPS_Window *win, size_t len);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_query_stats(RTPS_Connection *conn, char **json)
+ *
+ *  @brief      Ask the server for its counters and gauges
+ *
+ *  The reply is the server's "stats" message as JSON text:
+ *    counters  messages, bytes, errors, queue_stalls, udp_lost, udp_dropped,
+ *              overwrites, open_errors, frames, frame_ns_last, frame_ns_total,
+ *              frame_ns_max
+ *    gauges    clients, windows, queue_used, queue_size, rss_bytes
+ *    windows   per open window: fill, capacity, overwrites and, for
+ *              timestamped data, count and p50/p99/p999/max in ns per stage
+ *
+ *  @param      conn    RTPS_Connection
+ *  @param      json    Receives the reply; free() it when done
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_query_stats(RTPS_Connection *conn, char **json);
+
+
+
 /*!
  *---------------------------------------------------------------------------------------
  *
@@ -134,7 +525,9 @@ void RTPS_disconnect(RTPS_Connection *conn);
  *  @param      win             Pointer to RTPS_Window 
  *  @param      data            Pointer to DataPoint
  *
- *  @return     0 if successful; negative otherwise
+ *  @return     0 if sent, or queued in async mode; -6 if the async queue, the
+ *              shared-memory ring or the UDP socket was full and points were
+ *              dropped; other negative values on error
  *
  *---------------------------------------------------------------------------------------
  */
@@ -142,6 +535,54 @@ int RTPS_client_send(RTPS_Connection *conn, RTPS_Window *win, DataPoint *data);
 
 
 
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_send_batch(RTPS_Connection *conn, RTPS_Window *win,
+ *                                         const DataPoint *data, int n)
+ *
+ *  @brief      Send an array of DataPoint in one message
+ *
+ *  @param      conn            RTPS_Connection
+ *  @param      win             Pointer to RTPS_Window 
+ *  @param      data            Array of n DataPoint
+ *  @param      n               Number of points
+ *
+ *  @return     0 if sent, or queued in async mode; -6 if the async queue, the
+ *              shared-memory ring or the UDP socket was full and points were
+ *              dropped; other negative values on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_send_batch(RTPS_Connection *conn, RTPS_Window *win, const DataPoint *data, int n);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_send_columns(RTPS_Connection *conn, RTPS_Window *win,
+ *                                           const double *x, const double *const *y, int n)
+ *
+ *  @brief      Send a columnar block of points in one message
+ *
+ *  @param      conn            RTPS_Connection
+ *  @param      win             Pointer to RTPS_Window 
+ *  @param      x               n x values
+ *  @param      y               win->y_count pointers to n y values each
+ *  @param      n               Number of points
+ *
+ *  @return     0 if sent, or queued in async mode; -6 if the async queue, the
+ *              shared-memory ring or the UDP socket was full and points were
+ *              dropped; other negative values on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_send_columns(RTPS_Connection *conn, RTPS_Window *win,
+                             const double *x, const double *const *y, int n);
+
+
+
 /*!
  *---------------------------------------------------------------------------------------
  *
@@ -149,6 +590,10 @@ int RTPS_client_send(RTPS_Connection *conn, RTPS_Window *win, DataPoint *data);
  *  
  *  @brief      Initialize plot
  *
+ *  On success plot->id holds the window handle the server assigned; data sent with
+ *  this RTPS_Window is routed to that window. A connection may create any number of
+ *  windows.
+ *
  *  @param      conn            Instantiated RTPS_Connection pointer
  *  @param      plot            Instantiated RTPS_Window pointer
  *
@@ -160,6 +605,24 @@ int RTPS_client_create_plot(RTPS_Connection *conn, RTPS_Window *plot);
 
 
 
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_client_destroy_plot(RTPS_Connection *conn, RTPS_Window *plot)
+ *  
+ *  @brief      Close a window created with RTPS_client_create_plot()
+ *
+ *  @param      conn            Instantiated RTPS_Connection pointer
+ *  @param      plot            RTPS_Window holding the handle to close
+ *
+ *  @return     0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_destroy_plot(RTPS_Connection *conn, RTPS_Window *plot);
+
+
+
 /*!
  *---------------------------------------------------------------------------------------
  *
@@ -194,17 +657,70 @@ void RTPS_server_init();
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_server_shutdown(RTPS_Window *win)
+ *  @fn         void RTPS_server_set_headless(const char *dir, int dump_fps)
+ *
+ *  @brief      Render windows into memory instead of onto a display
+ *
+ *  Each window draws into an SDL_Surface through the software renderer, so neither
+ *  a display nor a GPU is needed. Must be called before RTPS_server_init(). With
+ *  a frame rate of 0 frames are drawn as soon as data arrives.
+ *
+ *  @param      dir             Directory that receives frames as rtps-<window>-<frame>.ppm;
+ *                              NULL for none. The string must outlive the server.
+ *  @param      dump_fps        Dumps per second for each window; 0 for every frame
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_headless(const char *dir, int dump_fps);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_server_set_frame_rate(int fps)
+ *
+ *  @brief      Set the rate at which dirty windows are redrawn
+ *
+ *  Must be called before windows are created.
+ *
+ *  @param      fps     Frames per second; 0 to present in step with the display (vsync)
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_frame_rate(int fps);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_server_set_latency_overlay(bool on)
  *
- *  @brief      RTPS server shutdown
+ *  @brief      Show each window's send-to-present latency in its top right corner
  *
- *  @param      win     RTPS_Window pointer
+ *  The readout gives p50 and p99 over the last second of timestamped data.
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_latency_overlay(bool on);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_shutdown(RTPS_Server *srv)
+ *
+ *  @brief      RTPS server shutdown; closes every window
+ *
+ *  @param      srv     RTPS_Server pointer
  *
  *  @return     0 if successful; negative otherwise
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_server_shutdown(RTPS_Window *win);
+int RTPS_server_shutdown(RTPS_Server *srv);
 
 
 /*!
@@ -225,7 +741,10 @@ bool RTPS_server_forced_exit();
  *
  *  @fn         int RTPS_wait_for_connection(RTPS_Connection *conn, int port)
  *
- *  @brief      Initialize Real-Time Plot Server
+ *  @brief      Open the Real-Time Plot Server listening socket
+ *
+ *  Returns without waiting; clients are accepted by the ingest thread started with
+ *  RTPS_server_start() for as long as the server runs.
  *
  *  @param      conn    Pointer to instantiated RTPS_Connection
  *  @param      port    TCP port number
@@ -241,18 +760,124 @@ int RTPS_wait_for_connection(RTPS_Connection *conn, int port);
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_server_update(RTPS_Connection *conn, RTPS_Window *win)
+ *  @fn         int RTPS_wait_for_endpoint(RTPS_Connection *conn, const char *endpoint)
  *
- *  @brief      RTPS server loop update
+ *  @brief      Open the listening socket given as a port number, "unix:/path" or
+ *              "unixpacket:/path"
+ *
+ *  A stale socket file at the path is replaced and removed again by
+ *  RTPS_disconnect(). Datagrams are only received on TCP ports.
+ *
+ *  @param      conn            Pointer to instantiated RTPS_Connection
+ *  @param      endpoint        Where to listen
+ *
+ *  @return     0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_wait_for_endpoint(RTPS_Connection *conn, const char *endpoint);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_start(RTPS_Server *srv, RTPS_Connection *conn)
+ *
+ *  @brief      Start the ingest thread
+ *
+ *  The ingest thread accepts clients on the listener and multiplexes them with epoll,
+ *  decoding their messages and handing the results to the calling thread through a
+ *  lock-free queue, drained by RTPS_server_update().
+ *
+ *  @param      srv     Pointer to zeroed RTPS_Server
+ *  @param      conn    Listening RTPS_Connection; used only by the ingest thread
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_start(RTPS_Server *srv, RTPS_Connection *conn);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_stop(RTPS_Server *srv)
+ *
+ *  @brief      Stop and join the ingest thread
  *
- *  @param      conn    RTPS_Connection pointer
- *  @param      win     RTPS_Window pointer
+ *  @param      srv     RTPS_Server pointer
  *
  *  @return     0 if successful; negative otherwise
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_server_update(RTPS_Connection *conn, RTPS_Window *win);
+int RTPS_server_stop(RTPS_Server *srv);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_update(RTPS_Server *srv)
+ *
+ *  @brief      RTPS server loop update
+ *
+ *  Applies everything the ingest thread has decoded to the windows; sleeps briefly
+ *  when there is nothing to do.
+ *
+ *  @param      srv     RTPS_Server pointer
+ *
+ *  @return     Number of events applied; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_update(RTPS_Server *srv);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_render(RTPS_Server *srv)
+ *
+ *  @brief      Redraw every window that has new data once a frame is due
+ *
+ *  The time spent drawing and presenting is added to srv->frames.
+ *
+ *  @param      srv     RTPS_Server pointer
+ *
+ *  @return     Number of windows presented; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_render(RTPS_Server *srv);
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_get_latency(RTPS_Server *srv, int id, int stage,
+ *                                          RTPS_LatencyStats *stats)
+ *
+ *  @brief      Latency of a window's timestamped data up to one stage
+ *
+ *  Covers everything received since the window was created. Call from the
+ *  render thread.
+ *
+ *  @param      srv     RTPS_Server pointer
+ *  @param      id      Window handle
+ *  @param      stage   RTPS_STAGE_*
+ *  @param      stats   Sample count and percentiles, in nanoseconds
+ *
+ *  @return     0 if successful; negative if there is no such window or stage
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_get_latency(RTPS_Server *srv, int id, int stage, RTPS_LatencyStats *stats);
 
 
 
@@ -0,0 +1,83 @@
+/*!
+ *---------------------------------------------------------------------------
+ *
+ * @file	rtps_proto.h
+ *
+ * @brief	RTPS wire format definitions
+ *
+ *---------------------------------------------------------------------------
+ */
+#ifndef __RTPS_PROTO_H__
+#define __RTPS_PROTO_H__
+
+#include <stdint.h>
+
+
+// Encodings a client may negotiate for "plot" data in the "create" command
+#define RTPS_ENCODING_JSON              0
+#define RTPS_ENCODING_BINARY            1
+
+// Stream framing: every message is preceded by its length as a little-endian u32
+#define RTPS_FRAME_HDR_LEN              4
+#define RTPS_MAX_FRAME_LEN              (16 * 1024 * 1024)
+
+// Binary message header
+#define RTPS_BIN_MAGIC                  0x5452          // "RT" on the wire
+#define RTPS_BIN_VERSION                1
+#define RTPS_BIN_HDR_LEN                12
+
+// Binary message types
+#define RTPS_MSG_PLOT                   1
+
+// Binary header flags
+#define RTPS_BIN_FLAG_TS                0x01            // a send timestamp follows the header
+#define RTPS_BIN_TS_LEN                 8
+
+// Offset of the points in a binary message
+#define RTPS_BIN_DATA_OFF(flags)        (RTPS_BIN_HDR_LEN + (((flags) & RTPS_BIN_FLAG_TS) ? RTPS_BIN_TS_LEN : 0))
+
+
+/*
+ *  Binary message layout; every field is little-endian.
+ *
+ *    offset  size  field
+ *    0       2     magic       RTPS_BIN_MAGIC
+ *    2       1     version     RTPS_BIN_VERSION
+ *    3       1     type        RTPS_MSG_*
+ *    4       2     window      window handle returned by "create"
+ *    6       1     y_count     number of series per point
+ *    7       1     flags       RTPS_BIN_FLAG_*; other bits 0
+ *    8       4     count       number of points that follow
+ *    12      8     sent        only with RTPS_BIN_FLAG_TS: u64 CLOCK_MONOTONIC
+ *                              nanoseconds when the client sent the batch
+ *    12/20   ...   points      count x { f64 x, f64 y[y_count] }
+ *
+ *  A JSON "plot" message carries the same timestamp as a "ts" key, which
+ *  must come before "data".
+ */
+typedef struct {
+   uint16_t magic;
+   uint8_t version;
+   uint8_t type;
+   uint16_t window;
+   uint8_t y_count;
+   uint8_t flags;
+   uint32_t count;
+}
+RTPS_BinHeader;
+
+
+#define RTPS_BIN_POINT_LEN(y_count)     (8 * (1 + (y_count)))
+
+
+/*
+ *  Datagram transport, sent to the server's port over UDP. Each datagram is
+ *  a little-endian u32 sequence number, counted per window by the sender,
+ *  followed by one binary "plot" message. Lost datagrams show up as gaps in
+ *  the sequence; late ones are discarded.
+ */
+#define RTPS_UDP_HDR_LEN                4
+#define RTPS_UDP_MAX_LEN                1400            // fits an Ethernet MTU unfragmented
+
+
+#endif  // __RTPS_PROTO_H__
@@ -0,0 +1,65 @@
+/*!
+ *---------------------------------------------------------------------------
+ *
+ * @file	spsc_ring.h
+ *
+ * @brief	Lock-free single-producer/single-consumer ring header file
+ *
+ *---------------------------------------------------------------------------
+ */
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define SPSC_CACHE_LINE         64
+#define SPSC_REC_HDR_LEN        8
+
+//
+// Variable-length records in a power-of-two byte ring. One thread reserves,
+// fills and commits records; another thread peeks and releases them in order.
+// head and tail are free-running byte counters kept on separate cache lines.
+// The ring holds no pointers, so spsc_init() can place it in memory shared by
+// two processes.
+//
+typedef struct {
+    _Atomic size_t head;
+    size_t res_pad;
+    size_t res_len;
+    uint8_t pad0[SPSC_CACHE_LINE - 3 * sizeof(size_t)];
+    _Atomic size_t tail;
+    uint8_t pad1[SPSC_CACHE_LINE - sizeof(size_t)];
+    size_t sz;
+    uint8_t pad2[SPSC_CACHE_LINE - sizeof(size_t)];
+    uint8_t data[];
+} SpscRing;
+
+//
+// Consumer of a ring in memory another process can write to at any time.
+// The size is taken once and the read position is kept here, so nothing the
+// producer writes can move a read outside the ring.
+//
+typedef struct {
+    SpscRing *ring;
+    size_t sz;
+    size_t tail;
+    size_t len;             // length of the record last peeked
+} SpscReader;
+
+SpscRing *spsc_create(size_t sz);
+SpscRing *spsc_init(void *mem, size_t len);
+bool spsc_valid(const SpscRing *ring, size_t len);
+void spsc_free(SpscRing *ring);
+void *spsc_reserve(SpscRing *ring, size_t len);
+void spsc_commit(SpscRing *ring, size_t len);
+void *spsc_peek(SpscRing *ring, size_t *len);
+void spsc_release(SpscRing *ring);
+bool spsc_empty(SpscRing *ring);
+size_t spsc_used(SpscRing *ring);
+bool spsc_reader_init(SpscReader *rd, SpscRing *ring, size_t len);
+int spsc_reader_peek(SpscReader *rd, void **rec, size_t *len);
+void spsc_reader_release(SpscReader *rd);
+
+#endif
@@ -0,0 +1,532 @@
+/*!
+ *=======================================================================================
+ *
+ * @file	rtps_bench.c
+ *
+ * @brief	End-to-end load generator and benchmark
+ *
+ * Runs a headless server in this process and drives it from sender threads, one per
+ * connection. Every sample is stamped with the time its batch is due to be sent,
+ * so send-to-present latency is measured against the schedule and includes any
+ * time a sender spent falling behind.
+ *
+ *=======================================================================================
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <rtps.h>
+
+
+#define BENCH_PORT              "12399"
+#define BENCH_X_RANGE           10.0            // seconds of data in view
+#define BENCH_MAX_WINDOW_POINTS 1000000         // x_step is raised to keep buffers below this
+#define BENCH_DRAIN_NS          1000000000ull   // rendering continues this long after sending
+#define BENCH_HIST_US           1000000         // latency histogram: 1 us buckets up to 1 s
+
+
+typedef struct {
+   int connections;
+   int windows;
+   int series;
+   double rate;                 // points per second, all windows together
+   int batch;
+   double seconds;
+   int fps;
+   const char *endpoint;
+   bool binary;
+   bool async;
+   bool shm;
+   bool udp;
+}
+BenchConfig;
+
+
+typedef struct {
+   int index;
+   RTPS_Window *win;            // windows index, index + connections, ...
+   int win_count;
+   unsigned long sent;          // points the send functions accepted
+   unsigned long dropped;       // points refused or dropped by the client library
+   int error;
+}
+BenchSender;
+
+
+static BenchConfig cfg = {
+   .connections = 1, .windows = 1, .series = 1, .rate = 100000, .batch = 100,
+   .seconds = 10, .fps = 60, .endpoint = BENCH_PORT
+};
+static double t0;               // x of sample 0, in seconds of RTPS_bench_clock()
+static double dt;               // x between samples of one window
+static atomic_int ready;
+static atomic_bool go;
+static atomic_bool stop;
+static unsigned long *hist;     // BENCH_HIST_US + 1 buckets, the last one for overflow
+static double latency_max;
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		double RTPS_bench_clock()
+ *
+ *  @brief	Monotonic clock in seconds
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+double RTPS_bench_clock()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_bench_sleep_until(double t)
+ *
+ *  @brief	Sleep until RTPS_bench_clock() reaches t
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_bench_sleep_until(double t)
+{
+   struct timespec ts;
+   ts.tv_sec = (time_t)t;
+   ts.tv_nsec = (long)((t - ts.tv_sec) * 1e9);
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		double RTPS_bench_due(double x)
+ *
+ *  @brief	Time the batch holding the sample at x was due to be sent
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+double RTPS_bench_due(double x)
+{
+   long long k = llround((x - t0) / dt);
+   return t0 + ((k / cfg.batch) * cfg.batch + cfg.batch - 1) * dt;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_bench_open(BenchSender *s, RTPS_Connection **conn)
+ *
+ *  @brief	Connect and create the windows of one sender
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_bench_open(BenchSender *s, RTPS_Connection **conn)
+{
+   char ip[] = "127.0.0.1";
+   char *endpoint = RTPS_is_all_digits(cfg.endpoint) ? ip : (char *)cfg.endpoint;
+   int port = RTPS_is_all_digits(cfg.endpoint) ? atoi(cfg.endpoint) : 0;
+
+   *conn = RTPS_connect(endpoint, port);
+   if (*conn == NULL) return -1;
+
+   if (cfg.binary && RTPS_client_set_encoding(*conn, RTPS_ENCODING_BINARY) < 0) return -2;
+
+   for (int i = 0; i < s->win_count; i++)
+   {
+      RTPS_Window *win = &s->win[i];
+      snprintf(win->title, sizeof(win->title), "bench %d", s->index + i * cfg.connections);
+      strcpy(win->x_label, "t (sec)");
+      strcpy(win->y_label, "y");
+      win->width = 800;
+      win->height = 400;
+      win->y_count = cfg.series;
+      win->x_range = BENCH_X_RANGE;
+      win->x_step = fmax(dt, BENCH_X_RANGE / BENCH_MAX_WINDOW_POINTS);
+      win->max_points = (int)(win->x_range / win->x_step);
+      win->y_min = -1.0;
+      win->y_max =  1.0;
+      win->x_grid_step = 1.0;
+      win->y_grid_step = 0.5;
+      for (int j = 0; j < cfg.series; j++)
+         win->y_color[j] = (RTPS_Color){ (30 * j) % 256, 255, (255 - 30 * j) % 256, 255 };
+
+      if (RTPS_client_create_plot(*conn, win) < 0) return -3;
+      if (cfg.shm && RTPS_client_attach_shm(*conn, win, 0) < 0) return -4;
+   }
+
+   if (cfg.udp && RTPS_client_enable_udp(*conn) < 0) return -5;
+   if (cfg.async && RTPS_client_start_async(*conn, 0, true) < 0) return -6;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void *RTPS_bench_sender(void *arg)
+ *
+ *  @brief	Sender thread: one batch per window each time a batch is due
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void *RTPS_bench_sender(void *arg)
+{
+   BenchSender *s = (BenchSender *)arg;
+   RTPS_Connection *conn = NULL;
+   double *x = malloc(cfg.batch * sizeof(double));
+   double *ys = malloc((size_t)cfg.batch * cfg.series * sizeof(double));
+   const double *y[MAX_Y_PLOTS];
+
+   if (x == NULL || ys == NULL || (s->error = RTPS_bench_open(s, &conn)) < 0)
+   {
+      if (s->error == 0) s->error = -1;
+      atomic_fetch_add(&ready, 1);
+      goto _err_ret;
+   }
+   for (int j = 0; j < cfg.series; j++)
+      y[j] = ys + j * cfg.batch;
+
+   atomic_fetch_add(&ready, 1);
+   while (!atomic_load(&go))
+      usleep(1000);
+
+   for (long long k = 0; !atomic_load(&stop); k += cfg.batch)
+   {
+      for (int i = 0; i < cfg.batch; i++)
+      {
+         x[i] = t0 + (k + i) * dt;
+         for (int j = 0; j < cfg.series; j++)
+            ys[j * cfg.batch + i] = sin(2.0 * M_PI * 0.5 * x[i] + j);
+      }
+      RTPS_bench_sleep_until(x[cfg.batch - 1]);
+
+      for (int w = 0; w < s->win_count; w++)
+      {
+         int rc = RTPS_client_send_columns(conn, &s->win[w], x, y, cfg.batch);
+         if (rc == -6)
+         {
+            s->dropped += cfg.batch;
+         }
+         else if (rc < 0)
+         {
+            s->error = rc;
+            goto _err_ret;
+         }
+         else
+         {
+            s->sent += cfg.batch;
+         }
+      }
+   }
+
+   if (cfg.async)
+      RTPS_client_flush(conn);
+
+_err_ret:
+   free(x);
+   free(ys);
+   return conn;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		unsigned long RTPS_bench_present(RTPS_Server *srv, double *last_x,
+ *		                                 uint64_t *frames)
+ *
+ *  @brief	Record the latency of every sample presented since the last call
+ *
+ *  @param	srv	Server that just rendered
+ *  @param	last_x	Newest x already counted, per window id
+ *  @param	frames	frame_count already seen, per window id
+ *
+ *  @return	Number of samples presented
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+unsigned long RTPS_bench_present(RTPS_Server *srv, double *last_x, uint64_t *frames)
+{
+   double now = RTPS_bench_clock();
+   unsigned long n = 0;
+
+   for (int i = 0; i < MAX_WINDOWS; i++)
+   {
+      RTPS_Window *win = srv->win[i];
+      if (win == NULL || win->frame_count == frames[i]) continue;
+      frames[i] = win->frame_count;
+
+      CircularBuffer *cb = &win->cb;
+      size_t count = cb_count(cb);
+      double newest = last_x[i];
+      for (size_t k = count; k-- > 0; )
+      {
+         double x = cb->x[cb_index(cb, k)];
+         if (x <= last_x[i]) break;
+         if (isnan(cb_y(cb, 0)[cb_index(cb, k)])) continue;      // UDP gap
+         if (x > newest) newest = x;
+
+         double us = (now - RTPS_bench_due(x)) * 1e6;
+         if (us > latency_max) latency_max = us;
+         hist[(us < 0) ? 0 : (us >= BENCH_HIST_US) ? BENCH_HIST_US : (size_t)us]++;
+         n++;
+      }
+      last_x[i] = newest;
+   }
+   return n;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		double RTPS_bench_percentile(unsigned long total, double p)
+ *
+ *  @brief	Latency in microseconds below which a fraction p of the samples fall
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+double RTPS_bench_percentile(unsigned long total, double p)
+{
+   unsigned long want = (unsigned long)ceil(p * total), seen = 0;
+
+   for (size_t i = 0; i <= BENCH_HIST_US; i++)
+   {
+      seen += hist[i];
+      if (seen >= want && seen > 0)
+         return (i < BENCH_HIST_US) ? i + 1 : latency_max;
+   }
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_bench_usage()
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_bench_usage()
+{
+   printf("Usage: rtps_bench [-c connections] [-w windows] [-k series] [-r points/sec]\n"
+          "                  [-n batch] [-t seconds] [-f fps] [-e port|unix:path|unixpacket:path]\n"
+          "                  [-b] [-a] [-s] [-u]\n"
+          "  -b binary encoding, -a async send queue, -s shared memory, -u UDP\n");
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn	 	main()
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int main(int argc, char *argv[])
+{
+   int rc = 0;
+   int opt;
+   RTPS_Connection conn = { .fd = -1, .client = -1, .udp_fd = -1 };
+   RTPS_Server server = {0};
+   BenchSender *senders = NULL;
+   pthread_t *threads = NULL;
+   int started = 0;
+
+   while ((opt = getopt(argc, argv, "c:w:k:r:n:t:f:e:basuh")) != -1)
+   {
+      switch (opt)
+      {
+         case 'c': cfg.connections = atoi(optarg); break;
+         case 'w': cfg.windows = atoi(optarg); break;
+         case 'k': cfg.series = atoi(optarg); break;
+         case 'r': cfg.rate = atof(optarg); break;
+         case 'n': cfg.batch = atoi(optarg); break;
+         case 't': cfg.seconds = atof(optarg); break;
+         case 'f': cfg.fps = atoi(optarg); break;
+         case 'e': cfg.endpoint = optarg; break;
+         case 'b': cfg.binary = true; break;
+         case 'a': cfg.async = true; break;
+         case 's': cfg.shm = true; break;
+         case 'u': cfg.udp = true; break;
+         default: RTPS_bench_usage(); return -1;
+      }
+   }
+   if (cfg.connections < 1 || cfg.windows < cfg.connections || cfg.windows > MAX_WINDOWS ||
+       cfg.series < 1 || cfg.series > MAX_Y_PLOTS || cfg.rate <= 0 || cfg.batch < 1 ||
+       cfg.seconds <= 0 || cfg.fps < 0)
+   {
+      printf("Error: need 1 <= connections <= windows <= %d, 1 <= series <= %d, "
+             "and positive rate, batch and seconds.\n", MAX_WINDOWS, MAX_Y_PLOTS);
+      return -1;
+   }
+   dt = cfg.windows / cfg.rate;
+
+   hist = calloc(BENCH_HIST_US + 1, sizeof(unsigned long));
+   double *last_x = malloc(MAX_WINDOWS * sizeof(double));
+   uint64_t *frames = calloc(MAX_WINDOWS, sizeof(uint64_t));
+   senders = calloc(cfg.connections, sizeof(BenchSender));
+   threads = calloc(cfg.connections, sizeof(pthread_t));
+   if (hist == NULL || last_x == NULL || frames == NULL || senders == NULL || threads == NULL)
+   {
+      rc = -1;
+      goto _err_ret;
+   }
+   for (int i = 0; i < MAX_WINDOWS; i++)
+      last_x[i] = -INFINITY;
+
+
+   // Headless server in this process; this thread renders
+   RTPS_server_set_headless(NULL, 0);
+   RTPS_server_init();
+   RTPS_server_set_frame_rate(cfg.fps);
+   if (RTPS_wait_for_endpoint(&conn, cfg.endpoint) < 0 || RTPS_server_start(&server, &conn) < 0)
+   {
+      RTPS_perror("Server failed to start.");
+      rc = -2;
+      goto _err_ret;
+   }
+
+
+   // Window w belongs to connection w % connections
+   for (int i = 0; i < cfg.connections; i++)
+   {
+      BenchSender *s = &senders[i];
+      s->index = i;
+      s->win_count = (cfg.windows - i + cfg.connections - 1) / cfg.connections;
+      s->win = calloc(s->win_count, sizeof(RTPS_Window));
+      if (s->win == NULL || pthread_create(&threads[i], NULL, RTPS_bench_sender, s) != 0)
+      {
+         rc = -3;
+         goto _err_stop;
+      }
+      started++;
+   }
+   while (atomic_load(&ready) < cfg.connections)
+   {
+      RTPS_server_update(&server);
+      RTPS_server_render(&server);
+   }
+   for (int i = 0; i < cfg.connections; i++)
+   {
+      if (senders[i].error < 0)
+      {
+         printf("Error: connection %d failed to set up (%d).\n", i, senders[i].error);
+         rc = -4;
+         goto _err_stop;
+      }
+   }
+
+
+   // Run
+   t0 = RTPS_bench_clock() + 0.05;
+   server.frames = (RTPS_FrameStats){0};
+   atomic_store(&go, true);
+
+   unsigned long presented = 0;
+   double end = t0 + cfg.seconds, last = t0;
+   double now;
+   while ((now = RTPS_bench_clock()) < end + BENCH_DRAIN_NS * 1e-9)
+   {
+      if (now >= end) atomic_store(&stop, true);
+      RTPS_server_update(&server);
+      if (RTPS_server_render(&server) > 0)
+      {
+         unsigned long n = RTPS_bench_present(&server, last_x, frames);
+         if (n > 0) last = RTPS_bench_clock();
+         presented += n;
+      }
+   }
+   RTPS_FrameStats fs = server.frames;
+
+
+   // Report
+   unsigned long sent = 0, dropped = 0;
+   int errors = 0;
+   atomic_store(&stop, true);
+   for (int i = 0; i < started; i++)
+   {
+      RTPS_Connection *c = NULL;
+      pthread_join(threads[i], (void **)&c);
+      RTPS_disconnect(c);
+      free(c);
+      sent += senders[i].sent;
+      dropped += senders[i].dropped;
+      if (senders[i].error < 0) errors++;
+   }
+   started = 0;
+
+   double elapsed = fmax(last - t0, 1e-9);
+   printf("config      %d connections, %d windows, %d series, %.0f points/s, batch %d, %s%s%s%s\n",
+          cfg.connections, cfg.windows, cfg.series, cfg.rate, cfg.batch,
+          cfg.binary ? "binary" : "json", cfg.async ? ", async" : "",
+          cfg.shm ? ", shm" : "", cfg.udp ? ", udp" : "");
+   printf("offered     %.0f points/s\n", sent / cfg.seconds);
+   printf("ingest      %.0f points/s\n", presented / elapsed);
+   printf("sent        %lu points, %lu dropped by client, %lu not presented\n",
+          sent, dropped, (sent > presented) ? sent - presented : 0);
+   printf("server      %lu queue stalls, %lu datagrams lost, %lu datagrams dropped\n",
+          atomic_load(&server.queue_stalls), atomic_load(&server.udp_lost),
+          atomic_load(&server.udp_dropped));
+   printf("render      %.1f fps, frame mean %.3f ms, max %.3f ms\n",
+          fs.count / elapsed,
+          fs.count ? fs.total_ns / 1e6 / fs.count : 0.0, fs.max_ns / 1e6);
+   printf("latency     p50 %.3f ms, p99 %.3f ms, p999 %.3f ms, max %.3f ms\n",
+          RTPS_bench_percentile(presented, 0.50) / 1e3,
+          RTPS_bench_percentile(presented, 0.99) / 1e3,
+          RTPS_bench_percentile(presented, 0.999) / 1e3, latency_max / 1e3);
+   if (errors > 0)
+   {
+      printf("Error: %d connections failed while sending.\n", errors);
+      rc = -5;
+   }
+
+_err_stop:
+   atomic_store(&go, true);
+   atomic_store(&stop, true);
+   for (int i = 0; i < started; i++)
+   {
+      RTPS_Connection *c = NULL;
+      pthread_join(threads[i], (void **)&c);
+      RTPS_disconnect(c);
+      free(c);
+   }
+   RTPS_server_stop(&server);
+
+_err_ret:
+   RTPS_disconnect(&conn);
+   RTPS_server_shutdown(&server);
+   for (int i = 0; senders != NULL && i < cfg.connections; i++)
+      free(senders[i].win);
+   free(senders);
+   free(threads);
+   free(frames);
+   free(last_x);
+   free(hist);
+   return rc;
+}
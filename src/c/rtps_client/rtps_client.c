@@ -28,9 +28,26 @@ char message[1024] = {0};
  *  Main logic
  *---------------------------------------------------------------------------------------
  */
-int main() 
+int main(int argc, char *argv[]) 
 {
     RTPS_Window plotwin = {0};
+    bool binary = false;
+    bool async = false;
+    bool shm = false;
+    bool udp = false;
+    bool stamp = false;
+    bool stats = false;
+    char *endpoint = SERVER_IP;
+    for (int i = 1; i < argc; i++)
+    {
+       if (0 == strcmp(argv[i], "-b")) binary = true;
+       else if (0 == strcmp(argv[i], "-a")) async = true;
+       else if (0 == strcmp(argv[i], "-s")) shm = true;
+       else if (0 == strcmp(argv[i], "-u")) udp = true;
+       else if (0 == strcmp(argv[i], "-t")) stamp = true;
+       else if (0 == strcmp(argv[i], "-S")) stats = true;
+       else endpoint = argv[i];    // IP address or unix:path, unixpacket:path
+    }
 
     strcpy(plotwin.title, "y(t) = 2*cos(2*pi*f*t)");
     strcpy(plotwin.x_label, "t (sec)");
@@ -64,19 +81,56 @@ int main()
 
 
     // Create socket
-    RTPS_Connection *conn = RTPS_connect(SERVER_IP, PORT);
+    RTPS_Connection *conn = RTPS_connect(endpoint, PORT);
     if (conn == NULL)
     {
        RTPS_perror("Client cannot connect to server.");
        return -2;
     }
 
+    // Print the server's counters and gauges, e.g. for a monitoring scraper
+    if (stats)
+    {
+       char *json;
+       int rc = RTPS_client_query_stats(conn, &json);
+       if (rc == 0)
+       {
+          printf("%s\n", json);
+          free(json);
+       }
+       else
+       {
+          RTPS_perror("Cannot get server stats.");
+       }
+       RTPS_disconnect(conn);
+       return (rc == 0) ? 0 : -4;
+    }
+
+    if (binary)
+       RTPS_client_set_encoding(conn, RTPS_ENCODING_BINARY);
+
+    // The server measures latency from these; same host only
+    if (stamp)
+       RTPS_client_set_timestamps(conn, true);
+
     if (RTPS_client_create_plot(conn, &plotwin) < 0)
     {
        RTPS_perror("Client cannot connect to server.");
        return -3;
     }
 
+    // Samples are written to a ring the server maps; same host only
+    if (shm && RTPS_client_attach_shm(conn, &plotwin, 0) < 0)
+       RTPS_perror("Cannot attach shared memory.");
+
+    // Samples are sent as datagrams; lost ones show as gaps
+    if (udp && RTPS_client_enable_udp(conn) < 0)
+       RTPS_perror("Cannot enable UDP.");
+
+    // Samples are queued and written by a sender thread
+    if (async && RTPS_client_start_async(conn, 0, true) < 0)
+       RTPS_perror("Cannot start async sending.");
+
     // Send messages
     bool done = false;
     DataPoint data = {0};
@@ -1,21 +1,48 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <math.h>
 #include <circular_buffer.h>
 
 
+// Wrap a position below 2 * sz back into the columns
+#ifdef CB_POW2
+#define CB_WRAP(cb, i)          ((i) & ((cb)->sz - 1))
+#else
+#define CB_WRAP(cb, i)          ((i) >= (cb)->sz ? (i) - (cb)->sz : (i))
+#endif
+
+
 //-------------------------------------------------------------------------
 // Initialize the buffer
+// Returns false if the columns cannot be allocated
 //-------------------------------------------------------------------------
-void cb_init(CircularBuffer *cb, size_t y_count, size_t sz) 
+bool cb_init(CircularBuffer *cb, size_t y_count, size_t sz) 
 {
-    cb->buffer = malloc(sizeof(DATA_TYPE) * (sz+2));
+    if (sz == 0)
+        sz = 1;
+#ifdef CB_POW2
+    size_t cap = 1;
+    while (cap < sz)
+        cap <<= 1;
+    sz = cap;
+#endif
+
+    cb->x = malloc(sizeof(double) * sz);
+    cb->y = malloc(sizeof(CB_Y_TYPE) * sz * (y_count > 0 ? y_count : 1));
+    if (cb->x == NULL || cb->y == NULL)
+    {
+        cb_free(cb);
+        return false;
+    }
+
     cb->sz = sz;
     cb->count = 0;
     cb->y_count = y_count;
     cb->head = 0;
     cb->tail = 0;
+    return true;
 }
 
 
@@ -24,34 +51,90 @@ void cb_init(CircularBuffer *cb, size_t y_count, size_t sz)
 //-------------------------------------------------------------------------
 void cb_free(CircularBuffer *cb) 
 {
-    free(cb->buffer);
+    free(cb->x);
+    free(cb->y);
+    cb->x = NULL;
+    cb->y = NULL;
 }
 
 
 //-------------------------------------------------------------------------
 //   Return next tail index
 //-------------------------------------------------------------------------
-static int cb_next_head(CircularBuffer *cb, int head)
+static size_t cb_next_head(CircularBuffer *cb, size_t head)
 {
-    return (head >= cb->sz-1) ? 0 : (head + 1); 
+    return CB_WRAP(cb, head + 1);
 }
    
 
 //-------------------------------------------------------------------------
 //   Return next tail index
 //-------------------------------------------------------------------------
-static int cb_prev_head(CircularBuffer *cb, int head)
+static size_t cb_prev_head(CircularBuffer *cb, size_t head)
 {
-    return (head <= 0) ? cb->sz-1 : (head - 1); 
+    return CB_WRAP(cb, head + cb->sz - 1);
 }
 
 //-------------------------------------------------------------------------
 //   Return next tail index
 //-------------------------------------------------------------------------
-static int cb_next_tail(CircularBuffer *cb, int tail)
+static size_t cb_next_tail(CircularBuffer *cb, size_t tail)
+{
+    return CB_WRAP(cb, tail + 1);
+}
+
+
+//-------------------------------------------------------------------------
+//   Gather the item at position idx
+//-------------------------------------------------------------------------
+static void cb_get(CircularBuffer *cb, size_t idx, DATA_TYPE *item)
+{
+    item->x = cb->x[idx];
+    for (size_t j = 0; j < cb->y_count; j++)
+        item->y[j] = cb->y[j * cb->sz + idx];
+}
+
+
+//-------------------------------------------------------------------------
+//   Copy n items from the columns x, y starting at src into position idx
+//   The run must not wrap
+//-------------------------------------------------------------------------
+static void cb_store(CircularBuffer *cb, size_t idx, const double *x,
+                     const double *const *y, size_t src, size_t n)
 {
-    return (tail >= cb->sz-1) ? 0 : (tail + 1);
-    // return (tail + 1) % cb->count;
+    memcpy(cb->x + idx, x + src, n * sizeof(double));
+    for (size_t j = 0; j < cb->y_count; j++)
+    {
+        CB_Y_TYPE *dst = cb_y(cb, j) + idx;
+        if (sizeof(CB_Y_TYPE) == sizeof(double))
+            memcpy(dst, y[j] + src, n * sizeof(double));
+        else
+            for (size_t k = 0; k < n; k++)
+                dst[k] = (CB_Y_TYPE)y[j][src + k];
+    }
+}
+
+
+//-------------------------------------------------------------------------
+//   Copy n items from position idx out to the columns x, y starting at dst
+//   The run must not wrap; x or y may be NULL
+//-------------------------------------------------------------------------
+static void cb_load(CircularBuffer *cb, size_t idx, double *x,
+                    double *const *y, size_t dst, size_t n)
+{
+    if (x != NULL)
+        memcpy(x + dst, cb->x + idx, n * sizeof(double));
+    if (y == NULL)
+        return;
+    for (size_t j = 0; j < cb->y_count; j++)
+    {
+        const CB_Y_TYPE *src = cb_y(cb, j) + idx;
+        if (sizeof(CB_Y_TYPE) == sizeof(double))
+            memcpy(y[j] + dst, src, n * sizeof(double));
+        else
+            for (size_t k = 0; k < n; k++)
+                y[j][dst + k] = src[k];
+    }
 }
 
 
@@ -63,10 +146,14 @@ bool cb_push(CircularBuffer *cb, DATA_TYPE item)
 {
     bool is_full = cb_full(cb);
 
-    cb->buffer[cb->head] = item;
+    cb->x[cb->head] = item.x;
+    for (size_t j = 0; j < cb->y_count; j++)
+        cb->y[j * cb->sz + cb->head] = (CB_Y_TYPE)item.y[j];
     cb->head = cb_next_head(cb, cb->head);
     if (!is_full) 
        cb->count = cb->count+1;
+    else
+       cb->tail = cb_next_tail(cb, cb->tail);   // oldest was overwritten
    
     return is_full;
 }
@@ -82,7 +169,7 @@ bool cb_pull(CircularBuffer *cb, DATA_TYPE *item)
     if (cb_empty(cb)) 
         return false;
    
-    *item = cb->buffer[cb->tail];
+    cb_get(cb, cb->tail, item);
     cb->tail = cb_next_tail(cb, cb->tail);
     cb->count = cb->count-1;
 
@@ -90,6 +177,88 @@ bool cb_pull(CircularBuffer *cb, DATA_TYPE *item)
 }
 
 
+//-------------------------------------------------------------------------
+// Add n items given as an x column and one y column per series
+// Only the newest sz items are kept when n exceeds the buffer size
+// Returns the number of items that were dropped or overwritten
+//-------------------------------------------------------------------------
+size_t cb_push_n(CircularBuffer *cb, const double *x, const double *const *y, size_t n)
+{
+    size_t skip = (n > cb->sz) ? n - cb->sz : 0;
+    n -= skip;
+
+    size_t run = cb->sz - cb->head;
+    if (run > n)
+        run = n;
+    cb_store(cb, cb->head, x, y, skip, run);
+    cb_store(cb, 0, x, y, skip + run, n - run);
+    cb->head = CB_WRAP(cb, cb->head + n);
+
+    size_t lost = skip;
+    if (cb->count + n > cb->sz)
+    {
+        lost += cb->count + n - cb->sz;
+        cb->count = cb->sz;
+        cb->tail = cb->head;                    // oldest were overwritten
+    }
+    else
+        cb->count += n;
+
+    return lost;
+}
+
+
+//-------------------------------------------------------------------------
+// Remove up to n of the oldest items into an x column and one y column per
+// series; x or y may be NULL to discard them
+// Returns the number of items removed
+//-------------------------------------------------------------------------
+size_t cb_pull_n(CircularBuffer *cb, double *x, double *const *y, size_t n)
+{
+    CbSpan span[2];
+    size_t done = 0;
+
+    int spans = cb_view(cb, 0, n, span);
+    for (int s = 0; s < spans; s++)
+    {
+        cb_load(cb, span[s].idx, x, y, done, span[s].len);
+        done += span[s].len;
+    }
+
+    cb->tail = CB_WRAP(cb, cb->tail + done);
+    cb->count -= done;
+    return done;
+}
+
+
+//-------------------------------------------------------------------------
+// Spans covering up to n items from logical index first, 0 being the oldest
+// Items are read in place through cb->x + idx and cb_y(cb, j) + idx
+// Returns the number of spans filled: 0, 1 or 2 when the range wraps
+//-------------------------------------------------------------------------
+int cb_view(CircularBuffer *cb, size_t first, size_t n, CbSpan span[2])
+{
+    if (first >= cb->count)
+        return 0;
+    if (n > cb->count - first)
+        n = cb->count - first;
+    if (n == 0)
+        return 0;
+
+    span[0].idx = cb_index(cb, first);
+    span[0].len = cb->sz - span[0].idx;
+    if (span[0].len >= n)
+    {
+        span[0].len = n;
+        return 1;
+    }
+
+    span[1].idx = 0;
+    span[1].len = n - span[0].len;
+    return 2;
+}
+
+
 //-------------------------------------------------------------------------
 // Peek next item to starting from buffer head
 // Returns head index, -1 if invalid  
@@ -103,7 +272,7 @@ int cb_peek_head(CircularBuffer *cb, int curr_head, DATA_TYPE *item)
         return -1;
 
     int head = (curr_head < 0) ? cb_prev_head(cb, cb->head) : cb_prev_head(cb, curr_head); 
-    *item = cb->buffer[head];
+    cb_get(cb, head, item);
     return head;
 }
 
@@ -120,11 +289,52 @@ int cb_peek_tail(CircularBuffer *cb, int curr_tail, DATA_TYPE *item)
         return -1;
    
     int tail = (curr_tail < 0) ? cb->tail : cb_next_tail(cb, curr_tail);
-    *item = cb->buffer[tail];
+    cb_get(cb, tail, item);
     return tail;
 }
 
 
+//-------------------------------------------------------------------------
+// Column position of logical index i, 0 being the oldest
+// Positions of consecutive items increase by one, wrapping from sz-1 to 0
+//-------------------------------------------------------------------------
+size_t cb_index(CircularBuffer *cb, size_t i)
+{
+    return CB_WRAP(cb, cb->tail + i);
+}
+
+
+//-------------------------------------------------------------------------
+// Start of y column j
+//-------------------------------------------------------------------------
+CB_Y_TYPE *cb_y(CircularBuffer *cb, size_t j)
+{
+    return cb->y + j * cb->sz;
+}
+
+
+//-------------------------------------------------------------------------
+// Logical index of the oldest item with x >= the given x, by binary search
+// Assumes x is non-decreasing from oldest to newest
+// Returns cb_count() if every item is below x
+//-------------------------------------------------------------------------
+size_t cb_lower_bound(CircularBuffer *cb, double x)
+{
+    size_t lo = 0;
+    size_t hi = cb->count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cb->x[cb_index(cb, mid)] < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
 //-------------------------------------------------------------------------
 // Check if buffer is empty
 //-------------------------------------------------------------------------
@@ -165,7 +375,8 @@ void cb_print(CircularBuffer *cb)
     int tail = -1;
     for (size_t i = 0; i < size; i++) 
     {
-	tail = cb_peek_tail(cb, tail, &data); 
+	if ((tail = cb_peek_tail(cb, tail, &data)) < 0)
+	    break;
         printf("tail=%d, x=%g ", tail, data.x);
 	for (int j=0; j < cb->y_count; j++)
            printf("y[%d]=%g ", j, data.y[j]);
@@ -230,6 +441,11 @@ int main()
     cb_push(&cb, data);
     cb_print(&cb);
 
+    // Test: Range lookup over the wrapped buffer
+    printf("lower_bound(0)=%ld lower_bound(3)=%ld lower_bound(4.5)=%ld lower_bound(200)=%ld\n",
+           cb_lower_bound(&cb, 0), cb_lower_bound(&cb, 3),
+           cb_lower_bound(&cb, 4.5), cb_lower_bound(&cb, 200));
+
     // Test: Pop all elements
     DataPoint val;
     printf("Pulling elements:\n");
@@ -249,6 +465,31 @@ int main()
     }
 #endif
 
+    // Test: Bulk push of more items than fit, then read in place and pull
+    double bx[10], by0[10], by1[10], ox[BUFFER_SIZE], oy0[BUFFER_SIZE], oy1[BUFFER_SIZE];
+    const double *by[2] = { by0, by1 };
+    const double *by3[2] = { by0 + 3, by1 + 3 };
+    double *oy[2] = { oy0, oy1 };
+    for (int i = 0; i < 10; i++)
+    {
+        bx[i] = 200 + i;
+        by0[i] = -bx[i];
+        by1[i] = 2 * bx[i];
+    }
+    cb_push_n(&cb, bx, by, 3);
+    printf("push_n lost=%ld\n", cb_push_n(&cb, bx + 3, by3, 7));
+    cb_print(&cb);
+
+    CbSpan span[2];
+    int spans = cb_view(&cb, 1, 4, span);
+    for (int s = 0; s < spans; s++)
+        printf("span %d: idx=%ld len=%ld x=%g..%g\n", s, span[s].idx, span[s].len,
+               cb.x[span[s].idx], cb.x[span[s].idx + span[s].len - 1]);
+
+    size_t n = cb_pull_n(&cb, ox, oy, BUFFER_SIZE);
+    for (size_t i = 0; i < n; i++)
+        printf("%g, %g, %g\n", ox[i], oy0[i], oy1[i]);
+
     cb_free(&cb);
 
     return 0;
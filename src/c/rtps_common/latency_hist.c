@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <latency_hist.h>
+
+
+//-------------------------------------------------------------------------
+// Bucket holding ns: values below 2^LH_SUB_BITS have their own bucket,
+// larger ones keep their top LH_SUB_BITS + 1 bits
+//-------------------------------------------------------------------------
+static inline size_t lh_bucket(uint64_t ns)
+{
+    if (ns < (1u << LH_SUB_BITS))
+        return (size_t)ns;
+
+    int msb = 63 - __builtin_clzll(ns);
+    if (msb >= LH_MAX_BITS)
+        return LH_BUCKETS - 1;
+
+    int shift = msb - LH_SUB_BITS;
+    return ((size_t)(shift + 1) << LH_SUB_BITS) + (size_t)((ns >> shift) - (1u << LH_SUB_BITS));
+}
+
+
+//-------------------------------------------------------------------------
+// Largest value that falls in bucket i
+//-------------------------------------------------------------------------
+static inline uint64_t lh_value(size_t i)
+{
+    if (i < (1u << LH_SUB_BITS))
+        return i;
+
+    int shift = (int)(i >> LH_SUB_BITS) - 1;
+    uint64_t base = (uint64_t)((i & ((1u << LH_SUB_BITS) - 1)) + (1u << LH_SUB_BITS)) << shift;
+    return base + ((uint64_t)1 << shift) - 1;
+}
+
+
+//-------------------------------------------------------------------------
+// Count n samples of ns nanoseconds
+//-------------------------------------------------------------------------
+void lh_record(LatencyHist *h, uint64_t ns, unsigned long n)
+{
+    if (h == NULL || n == 0)
+        return;
+
+    atomic_fetch_add_explicit(&h->count[lh_bucket(ns)], n, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, n, memory_order_relaxed);
+
+    unsigned long max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+
+//-------------------------------------------------------------------------
+// Copy the counts of h, e.g. to take percentiles of what is added later
+//-------------------------------------------------------------------------
+void lh_snapshot(const LatencyHist *h, LatencyHist *copy)
+{
+    for (size_t i = 0; i < LH_BUCKETS; i++)
+        atomic_store_explicit(&copy->count[i],
+                              atomic_load_explicit(&h->count[i], memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_store_explicit(&copy->total, atomic_load_explicit(&h->total, memory_order_relaxed),
+                          memory_order_relaxed);
+    atomic_store_explicit(&copy->max, atomic_load_explicit(&h->max, memory_order_relaxed),
+                          memory_order_relaxed);
+}
+
+
+//-------------------------------------------------------------------------
+// Samples recorded, or recorded since the snapshot since if not NULL
+//-------------------------------------------------------------------------
+unsigned long lh_count(const LatencyHist *h, const LatencyHist *since)
+{
+    unsigned long n = atomic_load_explicit(&h->total, memory_order_relaxed);
+    if (since != NULL)
+        n -= atomic_load_explicit(&since->total, memory_order_relaxed);
+    return n;
+}
+
+
+//-------------------------------------------------------------------------
+// Value below which a fraction p of the samples fall, counting only those
+// added since the snapshot since if it is not NULL. Reported as the top of
+// its bucket; 0 if there are no samples.
+//-------------------------------------------------------------------------
+uint64_t lh_percentile(const LatencyHist *h, const LatencyHist *since, double p)
+{
+    unsigned long c[LH_BUCKETS];
+    unsigned long total = 0;
+
+    // Sum the buckets read, not h->total, so a record in flight cannot skew p
+    for (size_t i = 0; i < LH_BUCKETS; i++)
+    {
+        c[i] = atomic_load_explicit(&h->count[i], memory_order_relaxed);
+        if (since != NULL)
+            c[i] -= atomic_load_explicit(&since->count[i], memory_order_relaxed);
+        total += c[i];
+    }
+    if (total == 0)
+        return 0;
+
+    unsigned long want = (unsigned long)(p * total);
+    if (want < 1)
+        want = 1;
+    if (want > total)
+        want = total;
+
+    unsigned long seen = 0;
+    for (size_t i = 0; i < LH_BUCKETS; i++)
+    {
+        seen += c[i];
+        if (seen >= want)
+        {
+            // The last bucket is open-ended
+            uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            uint64_t v = lh_value(i);
+            return (i == LH_BUCKETS - 1 || v > max) ? max : v;
+        }
+    }
+    return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+
+
+//#define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+#include <pthread.h>
+
+#define THREADS			4
+#define SAMPLES			1000000
+
+static LatencyHist hist;
+
+//-------------------------------------------------------------------------
+//  Recorder: 1..SAMPLES ns, split between the threads
+//-------------------------------------------------------------------------
+static void *recorder(void *arg)
+{
+    long t = (long)arg;
+    for (uint64_t v = 1 + t; v <= SAMPLES; v += THREADS)
+        lh_record(&hist, v, 1);
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+//  main()
+//-------------------------------------------------------------------------
+int main()
+{
+    int bad = 0;
+
+    // Every value maps into a bucket whose range holds it
+    for (uint64_t v = 0; v < (1ull << 40); v = v * 9 / 8 + 1)
+    {
+        size_t i = lh_bucket(v);
+        uint64_t lo = (i == 0) ? 0 : lh_value(i - 1) + 1;
+        if (i >= LH_BUCKETS || (v >> LH_MAX_BITS == 0 && (v < lo || v > lh_value(i))))
+        {
+            printf("Bucket %zu wrong for %llu\n", i, (unsigned long long)v);
+            bad++;
+        }
+    }
+
+    pthread_t tid[THREADS];
+    for (long t = 0; t < THREADS; t++)
+        pthread_create(&tid[t], NULL, recorder, (void *)t);
+    for (int t = 0; t < THREADS; t++)
+        pthread_join(tid[t], NULL);
+
+    double ps[] = { 0.5, 0.99, 0.999 };
+    for (int k = 0; k < 3; k++)
+    {
+        double got = (double)lh_percentile(&hist, NULL, ps[k]);
+        double want = ps[k] * SAMPLES;
+        printf("p%g %.0f (want %.0f)\n", ps[k] * 100, got, want);
+        if (got < want || got > want * 1.04)
+            bad++;
+    }
+
+    LatencyHist since;
+    lh_snapshot(&hist, &since);
+    lh_record(&hist, 5000, 10);
+    if (lh_count(&hist, &since) != 10 || lh_percentile(&hist, &since, 0.5) < 5000 ||
+        lh_percentile(&hist, &since, 0.5) > 5000 * 1.04 || lh_count(&hist, NULL) != SAMPLES + 10)
+        bad++;
+
+    printf("%s\n", bad ? "FAILED" : "PASSED");
+    return bad ? 1 : 0;
+}
+
+#endif // UNIT_TEST
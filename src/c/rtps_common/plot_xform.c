@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <plot_xform.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#define XFORM_LIMIT             ((double)XFORM_PX_LIMIT)
+
+
+//-------------------------------------------------------------------------
+//   Clamp to the pixel limit; NaN maps to +XFORM_LIMIT like the SIMD paths
+//-------------------------------------------------------------------------
+static inline double xform_clamp(double v)
+{
+    v = (v < XFORM_LIMIT) ? v : XFORM_LIMIT;
+    return (v > -XFORM_LIMIT) ? v : -XFORM_LIMIT;
+}
+
+
+//-------------------------------------------------------------------------
+//   Mark the lanes set in mask as gaps; returns how many
+//-------------------------------------------------------------------------
+static inline size_t xform_gaps(int *py, int mask, int lanes)
+{
+    size_t gaps = 0;
+    for (int k = 0; k < lanes; k++)
+    {
+        if (mask & (1 << k))
+        {
+            py[k] = XFORM_PX_GAP;
+            gaps++;
+        }
+    }
+    return gaps;
+}
+
+
+#if defined(__AVX2__)
+
+//-------------------------------------------------------------------------
+//   Load 4 y values as doubles
+//-------------------------------------------------------------------------
+static inline __m256d xform_load4_pd(const double *p) { return _mm256_loadu_pd(p); }
+static inline __m256d xform_load4_ps(const float *p)  { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+
+#define xform_load4(p)  _Generic((p), const float *: xform_load4_ps, \
+                                      const double *: xform_load4_pd)(p)
+
+//-------------------------------------------------------------------------
+//   Clamp 4 lanes to the pixel limit
+//-------------------------------------------------------------------------
+static inline __m256d xform_clamp4(__m256d v)
+{
+    const __m256d lim = _mm256_set1_pd(XFORM_LIMIT);
+    v = _mm256_min_pd(v, lim);
+    return _mm256_max_pd(v, _mm256_sub_pd(_mm256_setzero_pd(), lim));
+}
+
+#elif defined(__SSE2__)
+
+//-------------------------------------------------------------------------
+//   Load 2 y values as doubles
+//-------------------------------------------------------------------------
+static inline __m128d xform_load2_pd(const double *p) { return _mm_loadu_pd(p); }
+static inline __m128d xform_load2_ps(const float *p)
+{
+    return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i *)p)));
+}
+
+#define xform_load2(p)  _Generic((p), const float *: xform_load2_ps, \
+                                      const double *: xform_load2_pd)(p)
+
+//-------------------------------------------------------------------------
+//   Clamp 2 lanes to the pixel limit
+//-------------------------------------------------------------------------
+static inline __m128d xform_clamp2(__m128d v)
+{
+    const __m128d lim = _mm_set1_pd(XFORM_LIMIT);
+    v = _mm_min_pd(v, lim);
+    return _mm_max_pd(v, _mm_sub_pd(_mm_setzero_pd(), lim));
+}
+
+//-------------------------------------------------------------------------
+//   floor() of 2 lanes; SSE2 has no rounding instruction
+//   Rounds through 2^52, where the spacing of doubles is 1, then corrects
+//-------------------------------------------------------------------------
+static inline __m128d xform_floor2(__m128d v)
+{
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d big = _mm_set1_pd(4503599627370496.0);
+
+    __m128d c = _mm_or_pd(big, _mm_and_pd(v, sign));
+    __m128d r = _mm_sub_pd(_mm_add_pd(v, c), c);
+    r = _mm_sub_pd(r, _mm_and_pd(_mm_cmpgt_pd(r, v), _mm_set1_pd(1.0)));
+
+    // Values this large are integers already
+    __m128d small = _mm_cmplt_pd(_mm_andnot_pd(sign, v), big);
+    return _mm_or_pd(_mm_and_pd(small, r), _mm_andnot_pd(small, v));
+}
+
+#endif
+
+
+//-------------------------------------------------------------------------
+// Pixel columns of n x values: left + floor(x * scale) - origin
+//-------------------------------------------------------------------------
+void xform_x(const double *x, size_t n, double scale, double origin, int left, int *px)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256d s = _mm256_set1_pd(scale);
+    const __m256d o = _mm256_set1_pd(origin);
+    const __m128i l = _mm_set1_epi32(left);
+    for (; n - i >= 4; i += 4)
+    {
+        __m256d v = _mm256_floor_pd(_mm256_mul_pd(_mm256_loadu_pd(x + i), s));
+        v = xform_clamp4(_mm256_sub_pd(v, o));
+        _mm_storeu_si128((__m128i *)(px + i), _mm_add_epi32(_mm256_cvttpd_epi32(v), l));
+    }
+#elif defined(__SSE2__)
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d o = _mm_set1_pd(origin);
+    const __m128i l = _mm_set1_epi32(left);
+    for (; n - i >= 2; i += 2)
+    {
+        __m128d v = xform_floor2(_mm_mul_pd(_mm_loadu_pd(x + i), s));
+        v = xform_clamp2(_mm_sub_pd(v, o));
+        _mm_storel_epi64((__m128i *)(px + i), _mm_add_epi32(_mm_cvttpd_epi32(v), l));
+    }
+#endif
+
+    for (; i < n; i++)
+        px[i] = left + (int)xform_clamp(floor(x[i] * scale) - origin);
+}
+
+
+//-------------------------------------------------------------------------
+// Pixel rows of n y values: top + (int)((y_max - y) * scale)
+// scale is the plot height over the y range, computed once per frame
+// NaN values become XFORM_PX_GAP; returns how many there were
+//-------------------------------------------------------------------------
+size_t xform_y(const CB_Y_TYPE *y, size_t n, double y_max, double scale, int top, int *py)
+{
+    size_t i = 0, gaps = 0;
+
+#if defined(__AVX2__)
+    const __m256d s = _mm256_set1_pd(scale);
+    const __m256d m = _mm256_set1_pd(y_max);
+    const __m128i t = _mm_set1_epi32(top);
+    for (; n - i >= 4; i += 4)
+    {
+        __m256d v = _mm256_mul_pd(_mm256_sub_pd(m, xform_load4(y + i)), s);
+        _mm_storeu_si128((__m128i *)(py + i), _mm_add_epi32(_mm256_cvttpd_epi32(xform_clamp4(v)), t));
+
+        int nan = _mm256_movemask_pd(_mm256_cmp_pd(v, v, _CMP_UNORD_Q));
+        if (nan != 0)
+            gaps += xform_gaps(py + i, nan, 4);
+    }
+#elif defined(__SSE2__)
+    const __m128d s = _mm_set1_pd(scale);
+    const __m128d m = _mm_set1_pd(y_max);
+    const __m128i t = _mm_set1_epi32(top);
+    for (; n - i >= 2; i += 2)
+    {
+        __m128d v = _mm_mul_pd(_mm_sub_pd(m, xform_load2(y + i)), s);
+        _mm_storel_epi64((__m128i *)(py + i), _mm_add_epi32(_mm_cvttpd_epi32(xform_clamp2(v)), t));
+
+        int nan = _mm_movemask_pd(_mm_cmpunord_pd(v, v));
+        if (nan != 0)
+            gaps += xform_gaps(py + i, nan, 2);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        double v = (y_max - y[i]) * scale;
+        if (isnan(v))
+        {
+            py[i] = XFORM_PX_GAP;
+            gaps++;
+        }
+        else
+        {
+            py[i] = top + (int)xform_clamp(v);
+        }
+    }
+    return gaps;
+}
+
+
+//-------------------------------------------------------------------------
+// Widen [*min, *max] to cover n y values; NaN values are ignored
+//-------------------------------------------------------------------------
+void xform_minmax(const CB_Y_TYPE *y, size_t n, double *min, double *max)
+{
+    double lo = *min, hi = *max;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    if (n >= 4)
+    {
+        __m256d vlo = _mm256_set1_pd(lo), vhi = _mm256_set1_pd(hi);
+        for (; n - i >= 4; i += 4)
+        {
+            __m256d v = xform_load4(y + i);
+            vlo = _mm256_min_pd(v, vlo);            // keeps vlo when v is NaN
+            vhi = _mm256_max_pd(v, vhi);
+        }
+        double l[4], h[4];
+        _mm256_storeu_pd(l, vlo);
+        _mm256_storeu_pd(h, vhi);
+        for (int k = 0; k < 4; k++)
+        {
+            if (l[k] < lo) lo = l[k];
+            if (h[k] > hi) hi = h[k];
+        }
+    }
+#elif defined(__SSE2__)
+    if (n >= 2)
+    {
+        __m128d vlo = _mm_set1_pd(lo), vhi = _mm_set1_pd(hi);
+        for (; n - i >= 2; i += 2)
+        {
+            __m128d v = xform_load2(y + i);
+            vlo = _mm_min_pd(v, vlo);               // keeps vlo when v is NaN
+            vhi = _mm_max_pd(v, vhi);
+        }
+        double l[2], h[2];
+        _mm_storeu_pd(l, vlo);
+        _mm_storeu_pd(h, vhi);
+        for (int k = 0; k < 2; k++)
+        {
+            if (l[k] < lo) lo = l[k];
+            if (h[k] > hi) hi = h[k];
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        if (y[i] < lo) lo = y[i];
+        if (y[i] > hi) hi = y[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+
+//-------------------------------------------------------------------------
+// Minimum and maximum of n > 0 ints
+//-------------------------------------------------------------------------
+void xform_minmax_i(const int *v, size_t n, int *min, int *max)
+{
+    int lo = v[0], hi = v[0];
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    if (n >= 8)
+    {
+        __m256i vlo = _mm256_set1_epi32(lo), vhi = vlo;
+        for (; n - i >= 8; i += 8)
+        {
+            __m256i q = _mm256_loadu_si256((const __m256i *)(v + i));
+            vlo = _mm256_min_epi32(vlo, q);
+            vhi = _mm256_max_epi32(vhi, q);
+        }
+        int l[8], h[8];
+        _mm256_storeu_si256((__m256i *)l, vlo);
+        _mm256_storeu_si256((__m256i *)h, vhi);
+        for (int k = 0; k < 8; k++)
+        {
+            if (l[k] < lo) lo = l[k];
+            if (h[k] > hi) hi = h[k];
+        }
+    }
+#elif defined(__SSE2__)
+    if (n >= 4)
+    {
+        // No pminsd/pmaxsd before SSE4.1: select through a compare mask
+        __m128i vlo = _mm_set1_epi32(lo), vhi = vlo;
+        for (; n - i >= 4; i += 4)
+        {
+            __m128i q = _mm_loadu_si128((const __m128i *)(v + i));
+            __m128i lt = _mm_cmplt_epi32(q, vlo);
+            __m128i gt = _mm_cmpgt_epi32(q, vhi);
+            vlo = _mm_or_si128(_mm_and_si128(lt, q), _mm_andnot_si128(lt, vlo));
+            vhi = _mm_or_si128(_mm_and_si128(gt, q), _mm_andnot_si128(gt, vhi));
+        }
+        int l[4], h[4];
+        _mm_storeu_si128((__m128i *)l, vlo);
+        _mm_storeu_si128((__m128i *)h, vhi);
+        for (int k = 0; k < 4; k++)
+        {
+            if (l[k] < lo) lo = l[k];
+            if (h[k] > hi) hi = h[k];
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        if (v[i] < lo) lo = v[i];
+        if (v[i] > hi) hi = v[i];
+    }
+    *min = lo;
+    *max = hi;
+}
+
+
+//-------------------------------------------------------------------------
+// Instruction set the kernels were built for
+//-------------------------------------------------------------------------
+const char *xform_isa(void)
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+//#define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+#include <time.h>
+
+#define POINTS			100000
+#define SERIES			8
+#define ROUNDS			100
+
+static double x[POINTS];
+static CB_Y_TYPE y[SERIES][POINTS];
+static int px[POINTS], py[POINTS];
+
+//-------------------------------------------------------------------------
+//  main()
+//-------------------------------------------------------------------------
+int main()
+{
+    double scale = 720 / 10.0, origin = floor(12.3 * scale), y_scale = 280 / 4.0;
+    int bad = 0;
+
+    for (int i = 0; i < POINTS; i++)
+    {
+        x[i] = (i % 7 == 0) ? -x[i-1 > 0 ? i-1 : 0] : i * 0.000137 + 12.3;
+        for (int j = 0; j < SERIES; j++)
+            y[j][i] = (CB_Y_TYPE)(2.2 * sin(i * 0.001 * (j+1)) + (rand() / (double)RAND_MAX - 0.5));
+    }
+    y[0][5] = NAN;
+    y[0][POINTS-1] = NAN;
+    x[9] = 1e300;
+
+    // Compare with the expressions the kernels replace
+    xform_x(x, POINTS, scale, origin, 60, px);
+    for (int i = 0; i < POINTS; i++)
+        if (px[i] != 60 + (int)xform_clamp(floor(x[i] * scale) - origin))
+            bad++;
+    for (int j = 0; j < SERIES; j++)
+    {
+        size_t gaps = xform_y(y[j], POINTS, 2.0, y_scale, 60, py);
+        for (int i = 0; i < POINTS; i++)
+        {
+            if (isnan(y[j][i]) ? py[i] != XFORM_PX_GAP :
+                                 py[i] != 60 + (int)xform_clamp((2.0 - y[j][i]) * y_scale))
+                bad++;
+        }
+        if (gaps != (j == 0 ? 2 : 0))
+            bad++;
+
+        double lo = INFINITY, hi = -INFINITY, rlo = INFINITY, rhi = -INFINITY;
+        xform_minmax(y[j], POINTS, &lo, &hi);
+        for (int i = 0; i < POINTS; i++)
+        {
+            if (y[j][i] < rlo) rlo = y[j][i];
+            if (y[j][i] > rhi) rhi = y[j][i];
+        }
+        if (lo != rlo || hi != rhi)
+            bad++;
+
+        int ilo, ihi, rilo = py[0], rihi = py[0];
+        xform_minmax_i(py, POINTS, &ilo, &ihi);
+        for (int i = 0; i < POINTS; i++)
+        {
+            if (py[i] < rilo) rilo = py[i];
+            if (py[i] > rihi) rihi = py[i];
+        }
+        if (ilo != rilo || ihi != rihi)
+            bad++;
+    }
+    printf("%s: %d mismatches\n", xform_isa(), bad);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        xform_x(x, POINTS, scale, origin, 60, px);
+        for (int j = 0; j < SERIES; j++)
+            xform_y(y[j], POINTS, 2.0, y_scale, 60, py);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("%d series x %d points: %.3f ms per pass\n", SERIES, POINTS,
+           ((t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6) / ROUNDS);
+
+    return bad ? -1 : 0;
+}
+#endif // UNIT_TEST
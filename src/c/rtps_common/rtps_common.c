@@ -7,16 +7,92 @@
  *
  *=======================================================================================
  */
+#define _GNU_SOURCE             // accept4()
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <arpa/inet.h>
 #include <cjson/cJSON.h>
 #include <rtps.h>
 
+
+// Render tick, shared by all windows
+static uint64_t frame_interval_ns = 1000000000ull / DEFAULT_FRAME_RATE;
+static uint64_t next_frame_ns = 0;
+static bool frame_vsync = false;
+
+// Headless: windows render into memory; dump_dir, if set, receives PPM frames
+static bool headless = false;
+static const char *dump_dir = NULL;
+static uint64_t dump_interval_ns = 0;
+
+// Per-window latency readout, see RTPS_server_set_latency_overlay()
+static bool latency_overlay = false;
+
+
+// Records passed from the ingest thread to the render thread
+#define RTPS_EVENT_CREATE       1       // payload: RTPS_Window configuration
+#define RTPS_EVENT_PLOT         2       // payload: count x, then count y per series
+#define RTPS_EVENT_DESTROY      3       // no payload
+#define RTPS_EVENT_ATTACH       4       // payload: RTPS_ShmMap
+
+#define RTPS_PLOT_EVENT_LEN(n, y_count)  (sizeof(double) * (n) * (1 + (y_count)))
+
+typedef struct {
+   uint16_t type;
+   uint16_t window;
+   uint32_t count;
+   uint64_t sent_ns;            // PLOT: client send timestamp, or 0
+}
+RTPS_Event;
+
+typedef struct {
+   SpscRing *ring;              // mapped by the ingest thread, unmapped by the render thread
+   size_t len;
+   SpscReader rd;
+}
+RTPS_ShmMap;
+
+typedef struct {
+   const char *p;               // next unread character
+   const char *end;
+}
+RTPS_JsonCursor;
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         uint64_t RTPS_clock_ns()
+ *
+ *  @brief      Monotonic clock in nanoseconds
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+uint64_t RTPS_clock_ns()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
 /*!
  *---------------------------------------------------------------------------------------
  *
@@ -50,48 +126,105 @@ cJSON *cJSON_extract(cJSON *root, char typ, const char *key)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         void draw_grid(RTPS_Window *window, double x_offset)
+ *  @fn         int draw_grid_lines(RTPS_Window *window, SDL_Rect *lines, int n)
+ *
+ *  @brief      Fill n grid lines in one call
+ *
+ *  Grid lines are 1 pixel wide and axis-aligned, so they are drawn as rectangles.
  *
- *  @brief      Draw SDL grid
+ *  @return     0, the number of lines left to draw
  *
  *---------------------------------------------------------------------------------------
  */
 static
-void draw_grid(RTPS_Window *window, double x_offset)
+int draw_grid_lines(RTPS_Window *window, SDL_Rect *lines, int n)
 {
-    // Draw vertical grid lines and X labels
-    int plot_left   = PLOT_MARGIN_LEFT;
-    int plot_right  = window->width - PLOT_MARGIN_RIGHT;
-    int plot_top    = PLOT_MARGIN_TOP;
-    int plot_bottom = window->height - PLOT_MARGIN_BOTTOM;
-    int plot_width  = plot_right - plot_left;
-    int plot_height = plot_bottom - plot_top;
+    SDL_SetRenderDrawColor(window->sdlrendr, 200, 200, 200, 255);
+    SDL_RenderFillRects(window->sdlrendr, lines, n);
+    return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void draw_grid_x(RTPS_Window *window, double x_start, int left, int top)
+ *
+ *  @brief      Draw SDL grid lines and labels for x = x_start, x_start + x_grid_step, ...
+ *
+ *  @param      window  RTPS_Window pointer
+ *  @param      x_start First grid value, drawn at pixel column left
+ *  @param      left    Column of x_start
+ *  @param      top     Row of the top of the plot area
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void draw_grid_x(RTPS_Window *window, double x_start, int left, int top)
+{
+    SDL_Rect lines[64];
+    int n = 0;
 
-    // Horizontal grid lines (X axis)
-    double x_start_grid = ceil(x_offset / window->x_grid_step) * window->x_grid_step;
+    int plot_width  = window->width - PLOT_MARGIN_RIGHT - PLOT_MARGIN_LEFT;
+    int plot_height = window->height - PLOT_MARGIN_BOTTOM - PLOT_MARGIN_TOP;
 
-    for (double gx = x_start_grid; gx < x_offset + window->x_range; gx += window->x_grid_step)
+    for (int k = 0; k * window->x_grid_step < window->x_range; k++)
     {
-        int px = plot_left + (int)(((gx - x_offset) / window->x_range) * plot_width);
-        thickLineRGBA(window->sdlrendr, px, plot_top, px, plot_bottom, 1, 200, 200, 200, 255);
+        double gx = x_start + k * window->x_grid_step;
+        int px = left + (int)((k * window->x_grid_step / window->x_range) * plot_width);
+        lines[n++] = (SDL_Rect){ px, top, 1, plot_height + 1 };
+        if (n == sizeof(lines)/sizeof(lines[0]))
+            n = draw_grid_lines(window, lines, n);
 
         // Grid label
         char label[32];
         sprintf(label, "%.2f", gx);
-        stringRGBA(window->sdlrendr, px - 10, plot_bottom + 5, label, 80, 80, 80, 255);
+        stringRGBA(window->sdlrendr, px - PLOT_LABEL_PAD, top + plot_height + 5, label, 80, 80, 80, 255);
     }
 
-    // Vertical grid lines (Y axis)
+    draw_grid_lines(window, lines, n);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void draw_grid_y(RTPS_Window *window)
+ *
+ *  @brief      Draw SDL horizontal grid lines and y labels
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void draw_grid_y(RTPS_Window *window)
+{
+    SDL_Rect lines[64];
+    int n = 0;
+
+    int plot_left   = PLOT_MARGIN_LEFT;
+    int plot_right  = window->width - PLOT_MARGIN_RIGHT;
+    int plot_top    = PLOT_MARGIN_TOP;
+    int plot_bottom = window->height - PLOT_MARGIN_BOTTOM;
+    int plot_width  = plot_right - plot_left;
+    int plot_height = plot_bottom - plot_top;
+
     for (double gy = ceil(window->y_min / window->y_grid_step) * window->y_grid_step;
                     gy <= window->y_max; gy += window->y_grid_step)
     {
         int py = plot_top + (int)((window->y_max - gy) / (window->y_max - window->y_min) * plot_height);
-        thickLineRGBA(window->sdlrendr, plot_left, py, plot_right, py, 1, 200, 200, 200, 255);
+        lines[n++] = (SDL_Rect){ plot_left, py, plot_width + 1, 1 };
+        if (n == sizeof(lines)/sizeof(lines[0]))
+            n = draw_grid_lines(window, lines, n);
+
         // Grid label
         char label[16];
         sprintf(label, "%.1f", gy);
         stringRGBA(window->sdlrendr, plot_left - 35, py - 4, label, 80, 80, 80, 255);
     }
+
+    draw_grid_lines(window, lines, n);
 }
 
 
@@ -117,16 +250,15 @@ void draw_title(RTPS_Window *window)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         void draw_axes(RTPS_Window *window, double x_offset)
+ *  @fn         void draw_axes(RTPS_Window *window)
  *
- *  @brief      Draw SDL axes
+ *  @brief      Draw the y = 0 axis
  *
  *---------------------------------------------------------------------------------------
  */
 static
-void draw_axes(RTPS_Window *window, double x_offset)
+void draw_axes(RTPS_Window *window)
 {
-
     int plot_left   = PLOT_MARGIN_LEFT;
     int plot_right  = window->width - PLOT_MARGIN_RIGHT;
     int plot_top    = PLOT_MARGIN_TOP;
@@ -139,115 +271,366 @@ void draw_axes(RTPS_Window *window, double x_offset)
         int py = plot_top + (int)((window->y_max - 0) / (window->y_max - window->y_min) * plot_height);
         thickLineRGBA(window->sdlrendr, plot_left, py, plot_right, py, 2, 0, 0, 0, 255);
     }
+}
 
-#if 0
-    int plot_width  = plot_right - plot_left;
 
-    // Draw X axis (x=0)
-    if (x_offset < 0 && x_offset + window->x_range > 0)
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void draw_static(RTPS_Window *window)
+ *
+ *  @brief      Draw everything that does not move with the data
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void draw_static(RTPS_Window *window)
+{
+    SDL_SetRenderDrawColor(window->sdlrendr, 255, 255, 255, 255);
+    SDL_RenderClear(window->sdlrendr);
+
+    draw_grid_y(window);
+    draw_axes(window);
+    draw_title(window);
+
+    // Axis labels
+    stringRGBA(window->sdlrendr,
+               window->width/2 - 30, window->height - 35,
+               window->x_label,
+               0, 0, 0, 255);
+
+    stringRGBA(window->sdlrendr,
+               10, window->height/2,
+               window->y_label,
+               0, 0, 0, 255);
+}
+
+
+// Where data lands in the current render target
+typedef struct {
+    double x_scale;             // pixels per x unit
+    double origin;              // pixel column of x_offset, floor(x_offset * x_scale)
+    double y_scale;             // pixels per y unit
+    int left, top;              // corner of the plot area
+}
+RTPS_PlotMap;
+
+
+// Per-series reduction of the points falling in one pixel column
+typedef struct {
+    int col;
+    int first, last;
+    int min, max;
+    int seq, min_seq, max_seq;
+}
+RTPS_M4;
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void draw_polyline(RTPS_Window *window, int j, SDL_Point *pts, int n)
+ *
+ *  @brief      Draw series j through n vertices in a single call
+ *
+ *  Lines one pixel wide go straight to SDL_RenderDrawLines(). Wider lines become a
+ *  quad per segment, submitted as one triangle list with SDL_RenderGeometry().
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void draw_polyline(RTPS_Window *window, int j, SDL_Point *pts, int n)
+{
+    RTPS_Color *c = &window->y_color[j];
+
+    if (n < 2) return;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (PLOT_LINE_WIDTH > 1)
     {
-        int px = plot_left + (int)((0 - x_offset) / window->x_range * plot_width);
-        thickLineRGBA(window->sdlrendr, px, plot_top, px, plot_bottom, 2, 0, 0, 0, 255);
+        SDL_Color color = { c->r, c->g, c->b, c->a };
+        SDL_Vertex *v = window->plot_verts;
+        float half = PLOT_LINE_WIDTH / 2.0f;
+        int k = 0;
+
+        for (int i = 1; i < n; i++)
+        {
+            float x0 = pts[i-1].x + 0.5f, y0 = pts[i-1].y + 0.5f;
+            float x1 = pts[i].x + 0.5f,   y1 = pts[i].y + 0.5f;
+            float dx = x1 - x0, dy = y1 - y0;
+            float len = sqrtf(dx*dx + dy*dy);
+
+            // Segments going back in x are drawn too, as SDL_RenderDrawLines() does
+            if (len == 0) continue;
+
+            // Offset both ends by half the width along the segment normal
+            float nx = -dy / len * half;
+            float ny =  dx / len * half;
+            SDL_FPoint a = { x0 + nx, y0 + ny }, b = { x0 - nx, y0 - ny };
+            SDL_FPoint e = { x1 + nx, y1 + ny }, f = { x1 - nx, y1 - ny };
+
+            v[k++] = (SDL_Vertex){ a, color, {0, 0} };
+            v[k++] = (SDL_Vertex){ b, color, {0, 0} };
+            v[k++] = (SDL_Vertex){ e, color, {0, 0} };
+            v[k++] = (SDL_Vertex){ e, color, {0, 0} };
+            v[k++] = (SDL_Vertex){ b, color, {0, 0} };
+            v[k++] = (SDL_Vertex){ f, color, {0, 0} };
+        }
+        SDL_RenderGeometry(window->sdlrendr, NULL, v, k, NULL, 0);
+        return;
     }
 #endif
+
+    SDL_SetRenderDrawColor(window->sdlrendr, c->r, c->g, c->b, c->a);
+    SDL_RenderDrawLines(window->sdlrendr, pts, n);
 }
 
 
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int draw_plot(SDL_Renderer *renderer, 
- *                            RTPS_Window *win, 
- *                            double x_offset) 
+ *  @fn         void m4_flush(RTPS_Window *window, int j, RTPS_M4 *m4, int *n)
  *
- *  @brief      Draw SDL plot
+ *  @brief      Append the vertices of a finished pixel column of series j
  *
- *  @return     0 if success, negative otherwise
+ *  A column becomes at most first, min, max, last with min and max in the order they
+ *  occurred, which rasterizes to the same pixels as every segment inside it.
  *
  *---------------------------------------------------------------------------------------
  */
 static
-int draw_plot(RTPS_Window *window, double x_offset)
+void m4_flush(RTPS_Window *window, int j, RTPS_M4 *m4, int *n)
 {
-    int tail = -1;
-    DataPoint data1, data2;
-
-    if (window == NULL) return -1;
+    SDL_Point *pts = window->plot_pts + j * window->plot_pts_stride;
+    int y[4], k = 0;
 
-    if (cb_empty(&window->cb)) return -2;
+    // After a reset one carried point and a column of four must fit
+    if (window->plot_pts_stride < 8)
+        return;
 
-    int plot_left   = PLOT_MARGIN_LEFT;
-    int plot_right  = window->width - PLOT_MARGIN_RIGHT;
-    int plot_top    = PLOT_MARGIN_TOP;
-    int plot_bottom = window->height - PLOT_MARGIN_BOTTOM;
-    int plot_width  = plot_right - plot_left;
-    int plot_height = plot_bottom - plot_top;
+    // A column revisited out of order may not fit; draw what we have and carry on
+    if (*n + 4 > window->plot_pts_stride)
+    {
+        draw_polyline(window, j, pts, *n);
+        pts[0] = pts[*n - 1];
+        *n = 1;
+    }
 
-    tail = cb_peek_tail(&window->cb, tail, &data1);
-    if (tail < 0) return -3;
+    y[k++] = m4->first;
+    if (m4->min_seq < m4->max_seq)
+    {
+        y[k++] = m4->min;
+        y[k++] = m4->max;
+    }
+    else
+    {
+        y[k++] = m4->max;
+        y[k++] = m4->min;
+    }
+    y[k++] = m4->last;
 
-    for (int i = 1; i < window->cb.count; i++)
+    for (int i = 0; i < k; i++)
     {
-       tail = cb_peek_tail(&window->cb, tail, &data2);
+        if (*n > 0 && pts[*n - 1].x == m4->col && pts[*n - 1].y == y[i]) continue;
+        pts[*n].x = m4->col;
+        pts[*n].y = y[i];
+        (*n)++;
+    }
+}
 
-       if (data2.x < x_offset)
-          continue;
-       if (data1.x > x_offset + window->x_range)
-          break;
 
-       for (int j = 0; j < window->cb.y_count; j++)
-       {
-           int x1 = plot_left + (int)(((data1.x - x_offset) / window->x_range) * plot_width);
-           int y1 = plot_top  + (int)((window->y_max- data1.y[j]) / (window->y_max - window->y_min)
-                                                * plot_height);
-           int x2 = plot_left + (int)(((data2.x - x_offset) / window->x_range) * plot_width);
-           int y2 = plot_top  + (int)((window->y_max - data2.y[j]) / (window->y_max - window->y_min)
-                                                * plot_height);
-
-           if (x2 >= x1)
-              thickLineRGBA(window->sdlrendr, x1, y1, x2, y2, 2,
-                            window->y_color[j].r, window->y_color[j].g,
-                            window->y_color[j].b, window->y_color[j].a);
-       }
-       data1 = data2;
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void m4_feed(RTPS_Window *window, int j, RTPS_M4 *m, int *n, int col,
+ *                           const int *py, size_t len, bool first)
+ *
+ *  @brief      Add a run of len rows of series j, all in pixel column col
+ *
+ *  Columns are counted from x = 0 so a point keeps its column as the plot scrolls.
+ *  Long runs are reduced with xform_minmax_i(); the position of a new extreme is only
+ *  looked up when it beats the column so far.
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void m4_feed(RTPS_Window *window, int j, RTPS_M4 *m, int *n, int col,
+             const int *py, size_t len, bool first)
+{
+    size_t i = 0;
+
+    if (first || col != m->col)
+    {
+        if (!first) m4_flush(window, j, m, n);
+        m->col = col;
+        m->first = m->last = m->min = m->max = py[0];
+        m->seq = m->min_seq = m->max_seq = 0;
+        i = 1;
     }
-    return 0;
+    if (i >= len) return;
+
+    // Sequence number of py[k] is base + k
+    int base = m->seq + 1 - (int)i;
+    int min, max;
+    xform_minmax_i(py + i, len - i, &min, &max);
+    if (min < m->min)
+    {
+        size_t k = i;
+        while (py[k] != min) k++;
+        m->min = min;
+        m->min_seq = base + (int)k;
+    }
+    if (max > m->max)
+    {
+        size_t k = i;
+        while (py[k] != max) k++;
+        m->max = max;
+        m->max_seq = base + (int)k;
+    }
+    m->seq += (int)(len - i);
+    m->last = py[len - 1];
 }
 
 
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void m4_feed_gaps(RTPS_Window *window, int j, RTPS_M4 *m, int *n, int col,
+ *                                const int *py, size_t len, bool *first)
+ *
+ *  @brief      Add a run of series j that contains gaps
+ *
+ *  The polyline so far is drawn at each gap and a new one starts after it.
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void m4_feed_gaps(RTPS_Window *window, int j, RTPS_M4 *m, int *n, int col,
+                  const int *py, size_t len, bool *first)
+{
+    for (size_t a = 0, b; a < len; a = b + 1)
+    {
+        for (b = a; b < len && py[b] != XFORM_PX_GAP; b++);
+        if (b > a)
+        {
+            m4_feed(window, j, m, n, col, py + a, b - a, *first);
+            *first = false;
+        }
+        if (b < len && !*first)
+        {
+            m4_flush(window, j, m, n);
+            draw_polyline(window, j, window->plot_pts + j * window->plot_pts_stride, *n);
+            *n = 0;
+            *first = true;
+        }
+    }
+}
+
 
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_server_recv(RTPS_Connection *conn, char *message, size_t sz)
+ *  @fn         int draw_plot(RTPS_Window *window, const RTPS_PlotMap *map,
+ *                            double x_offset, size_t first)
  *
- *  @brief      Read data from a connection
+ *  @brief      Draw SDL plot from point first up to the right edge
  *
- *  @param      conn            Pointer to established connection
- *  @param      message         Pointer to message buffer
- *  @param      sz              Size of the buffer
+ *  Each series is reduced to at most four vertices per pixel column before drawing,
+ *  so the cost follows the plot width rather than the number of buffered points.
+ *  NaN values are gaps: the line stops before them and resumes after.
  *
- *  @return     0 if success; negative otherwise
+ *  @param      window  RTPS_Window pointer
+ *  @param      map     Mapping to the render target
+ *  @param      x_offset  x at the left edge
+ *  @param      first   Logical buffer index of the first point to draw from
+ *
+ *  @return     0 if success, negative otherwise
  *
  *---------------------------------------------------------------------------------------
  */
 static
-int RTPS_server_recv(int client, char *message, size_t sz)
+int draw_plot(RTPS_Window *window, const RTPS_PlotMap *map, double x_offset, size_t first)
 {
-   int rc = 0;
+    int n[MAX_Y_PLOTS] = {0};
+    RTPS_M4 m4[MAX_Y_PLOTS];
+    CircularBuffer *cb;
 
-   int valread = recv(client, message, sz-1, 0);
-   if (valread > 0)
-   {
-      message[valread] = '\0'; // Null-terminate the received message
-   }
-   else
-   {
-      rc = -1;
-   }
-   return rc;
-}
+    if (window == NULL) return -1;
+
+    cb = &window->cb;
+    if (cb_empty(cb)) return -2;
+
+    // Room for four vertices per column, plus the columns just outside either edge
+    int plot_width = window->width - PLOT_MARGIN_RIGHT - PLOT_MARGIN_LEFT;
+    int stride = 4 * (plot_width + 3);
+    if (window->plot_pts == NULL || window->plot_pts_stride != stride)
+    {
+        SDL_Point *pts = realloc(window->plot_pts, sizeof(SDL_Point) * stride * MAX_Y_PLOTS);
+        if (pts == NULL) return -4;
+        window->plot_pts = pts;
+
+        SDL_Vertex *verts = realloc(window->plot_verts, sizeof(SDL_Vertex) * 6 * stride);
+        if (verts == NULL) return -4;
+        window->plot_verts = verts;
+        window->plot_pts_stride = stride;
+    }
+
+    double x_end = x_offset + window->x_range;
+    size_t count = cb_count(cb);
+    if (first + 1 >= count || cb->x[cb_index(cb, first)] > x_end) return 0;
+
+    // Up to and including the first point right of the plot
+    size_t end = cb_lower_bound(cb, nextafter(x_end, INFINITY)) + 1;
+    if (end > count) end = count;
+
+    // Transform the buffer in place, a chunk at a time, then reduce each run of
+    // points sharing a pixel column
+    int px[PLOT_XFORM_CHUNK];
+    int py[MAX_Y_PLOTS][PLOT_XFORM_CHUNK];
+    size_t gaps[MAX_Y_PLOTS];
+    bool start[MAX_Y_PLOTS];
+    CbSpan span[2];
+    int spans = cb_view(cb, first, end - first, span);
+    for (int j = 0; j < window->y_count; j++)
+       start[j] = true;
+    for (int s = 0; s < spans; s++)
+    {
+       for (size_t off = 0; off < span[s].len; off += PLOT_XFORM_CHUNK)
+       {
+          size_t idx = span[s].idx + off;
+          size_t len = span[s].len - off;
+          if (len > PLOT_XFORM_CHUNK) len = PLOT_XFORM_CHUNK;
+
+          xform_x(cb->x + idx, len, map->x_scale, map->origin, map->left, px);
+          for (int j = 0; j < window->y_count; j++)
+             gaps[j] = xform_y(cb_y(cb, j) + idx, len, window->y_max, map->y_scale, map->top, py[j]);
+
+          for (size_t a = 0, b; a < len; a = b)
+          {
+             for (b = a + 1; b < len && px[b] == px[a]; b++);
+             for (int j = 0; j < window->y_count; j++)
+             {
+                if (gaps[j] > 0)
+                {
+                   m4_feed_gaps(window, j, &m4[j], &n[j], px[a], py[j] + a, b - a, &start[j]);
+                }
+                else
+                {
+                   m4_feed(window, j, &m4[j], &n[j], px[a], py[j] + a, b - a, start[j]);
+                   start[j] = false;
+                }
+             }
+          }
+       }
+    }
 
+    for (int j = 0; j < window->y_count; j++)
+    {
+       if (!start[j]) m4_flush(window, j, &m4[j], &n[j]);
+       draw_polyline(window, j, window->plot_pts + j * window->plot_pts_stride, n[j]);
+    }
+    return 0;
+}
 
 
 
@@ -394,34 +777,30 @@ int RTPS_win_to_cjson(RTPS_Window *win, cJSON *root)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_cjson_to_data(cJSON *root, DataPoint *data)
+ *  @fn		int RTPS_tx_reserve(RTPS_TxBuffer *tx, size_t len)
  *
- *  @brief	Extract cJSON into DataPoint object
+ *  @brief	Make room for len more bytes in an output buffer
  *
- *  @param	root		root cJSON
- *  @param	data		DataPoint pointer
+ *  The buffer only grows, so once it has held the largest message no more
+ *  allocations happen.
  *
- *  @return	0 if success; negative otherwise
+ *  @return	0 if successful; negative otherwise
  *
  *---------------------------------------------------------------------------------------
  */
 static
-int RTPS_cjson_to_data(cJSON *root, DataPoint *dat)
+int RTPS_tx_reserve(RTPS_TxBuffer *tx, size_t len)
 {
-   cJSON *y;
+   if (tx->len + len <= tx->cap) return 0;
 
-   if (dat == NULL || root == NULL) return -1;
-
-   int k = 0;
-   cJSON_ArrayForEach(y, root)
-   {  
-      if (k == 0)
-         dat->x = y->valuedouble;
-      else
-         dat->y[k-1] = y->valuedouble;
-      k++;
-   }
+   size_t cap = (tx->cap > 0) ? tx->cap : MAX_JSON_LEN;
+   while (cap < tx->len + len)
+      cap *= 2;
 
+   uint8_t *buf = realloc(tx->buf, cap);
+   if (buf == NULL) return -1;
+   tx->buf = buf;
+   tx->cap = cap;
    return 0;
 }
 
@@ -429,104 +808,663 @@ int RTPS_cjson_to_data(cJSON *root, DataPoint *dat)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_data_to_cjson(DataPoint *dat, cJSON *root, int sz)
- *
- *  @brief	Convert DataPoint to equivalent cJSON
+ *  @fn		void RTPS_put_json_number(RTPS_TxBuffer *tx, double v)
  *
- *  @param	dat	Pointer to the DataPoint object
- *  @param	root	Pointer to already-created cJSON object
- *  @param	sz	Size of y array
+ *  @brief	Append v as a JSON number, formatted the way cJSON prints it
  *
- *  @return	0 if successful; negative otherwise
+ *  The caller reserves MAX_JSON_NUM_LEN bytes.
  *
  *---------------------------------------------------------------------------------------
  */
 static
-int RTPS_data_to_cjson(DataPoint *dat, cJSON *root, RTPS_Window *win)
+void RTPS_put_json_number(RTPS_TxBuffer *tx, double v)
 {
-   if (dat == NULL || root == NULL || win == NULL) return -1;
-
-   cJSON_AddStringToObject(root, "cmd", "plot");
+   char *p = (char *)tx->buf + tx->len;
+   int len;
 
-   cJSON *yarray = cJSON_CreateArray();
-   cJSON_AddItemToArray(yarray, cJSON_CreateNumber(dat->x)); 
-   for (int i=0; i < win->y_count; i++)
+   if (isnan(v) || isinf(v))
    {
-      cJSON_AddItemToArray(yarray, cJSON_CreateNumber(dat->y[i])); 
+      memcpy(p, "null", 4);
+      len = 4;
    }
-   cJSON_AddItemToObject(root, "data", yarray);
-
-   return 0;
+   else if (fabs(v) < 1e15 && v == (double)(long long)v)
+   {
+      len = sprintf(p, "%lld", (long long)v);
+   }
+   else
+   {
+      // Shortest of the two precisions that reads back exactly
+      len = sprintf(p, "%1.15g", v);
+      if (strtod(p, NULL) != v)
+         len = sprintf(p, "%1.17g", v);
+   }
+   tx->len += len;
 }
 
 
-
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		void RTPS_perror(char *msg)
+ *  @fn		int RTPS_points_to_json(const DataPoint *pts, const double *x,
+ *                                      const double *const *y, int n, bool nested,
+ *                                      uint64_t ts, RTPS_Window *win, RTPS_TxBuffer *tx)
  *
- *  @brief	Print error message
+ *  @brief	Append a "plot" command for a batch of points to an output buffer
+ *
+ *  The points come either from an array of DataPoint (pts) or from columns (x, y).
+ *  Text is written straight into tx; no JSON tree is built.
+ *
+ *  @param	pts	Array of n DataPoint, or NULL when columns are given
+ *  @param	x	Column of n x values, used when pts is NULL
+ *  @param	y	win->y_count columns of n y values, used when pts is NULL
+ *  @param	n	Number of points
+ *  @param	nested	"data" is an array of points; otherwise the single point itself
+ *  @param	ts	Send timestamp for the "ts" key; 0 to leave it out
+ *  @param	win	Window the points belong to
+ *  @param	tx	Output buffer
+ *
+ *  @return	Appended length if successful; negative otherwise
  *
  *---------------------------------------------------------------------------------------
  */
-void RTPS_perror(char *msg)
+static
+int RTPS_points_to_json(const DataPoint *pts, const double *x, const double *const *y, int n,
+                        bool nested, uint64_t ts, RTPS_Window *win, RTPS_TxBuffer *tx)
 {
-   printf("Error: %s\n", msg);
+   if (win == NULL || tx == NULL || n < 0) return -1;
+   if (pts == NULL && (x == NULL || y == NULL)) return -1;
+   if (win->y_count < 0 || win->y_count > MAX_Y_PLOTS) return -2;
+
+   size_t start = tx->len;
+   size_t need = 64 + (size_t)n * (3 + (1 + win->y_count) * (MAX_JSON_NUM_LEN + 1));
+   if (RTPS_tx_reserve(tx, need) < 0) return -3;
+
+   tx->len += sprintf((char *)tx->buf + tx->len, "{\"cmd\":\"plot\",\"window\":%d,", win->id);
+   if (ts != 0)
+      tx->len += sprintf((char *)tx->buf + tx->len, "\"ts\":%llu,", (unsigned long long)ts);
+   tx->len += sprintf((char *)tx->buf + tx->len, "\"data\":%s", nested ? "[" : "");
+   for (int i = 0; i < n; i++)
+   {
+      if (i > 0) tx->buf[tx->len++] = ',';
+      tx->buf[tx->len++] = '[';
+      RTPS_put_json_number(tx, pts ? pts[i].x : x[i]);
+      for (int j = 0; j < win->y_count; j++)
+      {
+         tx->buf[tx->len++] = ',';
+         RTPS_put_json_number(tx, pts ? pts[i].y[j] : y[j][i]);
+      }
+      tx->buf[tx->len++] = ']';
+   }
+   if (nested) tx->buf[tx->len++] = ']';
+   tx->buf[tx->len++] = '}';
+
+   return (int)(tx->len - start);
 }
 
 
+
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_is_all_digits(const char *str) 
+ *  @fn		void RTPS_put_le16(uint8_t *p, uint16_t v)
+ *  @fn		void RTPS_put_le32(uint8_t *p, uint32_t v)
+ *  @fn		void RTPS_put_le64(uint8_t *p, uint64_t v)
+ *  @fn		void RTPS_put_f64(uint8_t *p, double v)
  *
- *  @brief 	 Returns 1 if str is made only of digits, 0 otherwise
+ *  @brief	Store a value little-endian at p
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_is_all_digits(const char *str) 
+static
+void RTPS_put_le16(uint8_t *p, uint16_t v)
 {
-   if (!str || !*str) return 0; // Empty string or NULL is not valid
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+}
 
-   for (; *str; ++str) 
-   {
-      if (!isdigit((unsigned char)*str)) 
-         return 0;
-   }
-   return 1;
+static
+void RTPS_put_le32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static
+void RTPS_put_le64(uint8_t *p, uint64_t v)
+{
+   RTPS_put_le32(p, (uint32_t)v);
+   RTPS_put_le32(p+4, (uint32_t)(v >> 32));
 }
 
+static
+void RTPS_put_f64(uint8_t *p, double v)
+{
+   uint64_t u;
+   memcpy(&u, &v, sizeof(u));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   u = __builtin_bswap64(u);
+#endif
+   memcpy(p, &u, sizeof(u));
+}
 
 
 /*!
  *---------------------------------------------------------------------------------------
- *  
- *  @fn		RTPS_Connection *RTPS_connect(char *ipaddr, int port)
  *
- *  @brief	Connect to a Real-Time Plot Server at <ipaddr:port>
- *
- *  @param	ipaddr	        IP address where the RTPS server is running	
- *  @param	port	 	Port at which RTPS is listening	
+ *  @fn		uint16_t RTPS_get_le16(const uint8_t *p)
+ *  @fn		uint32_t RTPS_get_le32(const uint8_t *p)
+ *  @fn		uint64_t RTPS_get_le64(const uint8_t *p)
+ *  @fn		double RTPS_get_f64(const uint8_t *p)
  *
- *  @return	RTPS_Connection pointer if successful, otherwise NULL 
+ *  @brief	Load a little-endian value from p
  *
  *---------------------------------------------------------------------------------------
  */
-RTPS_Connection *RTPS_connect(char *ipaddr, int port)
+static
+uint16_t RTPS_get_le16(const uint8_t *p)
 {
-    RTPS_Connection *conn = NULL;
-    
-    if (ipaddr == NULL) 
-    {
-       RTPS_perror("IP address is NULL");
-       goto _err_ret;
-    }
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
 
-    conn = (RTPS_Connection *)malloc(sizeof(RTPS_Connection));
-    if (conn != NULL) 
+static
+uint32_t RTPS_get_le32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static
+uint64_t RTPS_get_le64(const uint8_t *p)
+{
+   return (uint64_t)RTPS_get_le32(p) | ((uint64_t)RTPS_get_le32(p+4) << 32);
+}
+
+static
+double RTPS_get_f64(const uint8_t *p)
+{
+   uint64_t u;
+   double v;
+   memcpy(&u, p, sizeof(u));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   u = __builtin_bswap64(u);
+#endif
+   memcpy(&v, &u, sizeof(v));
+   return v;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_points_to_bin(const DataPoint *pts, const double *x,
+ *                                     const double *const *y, int n, uint64_t ts,
+ *                                     RTPS_Window *win, uint8_t *buf, size_t sz)
+ *
+ *  @brief	Encode a batch of points as a binary "plot" message
+ *
+ *  The points come either from an array of DataPoint (pts) or from columns (x, y).
+ *
+ *  @param	pts	Array of n DataPoint, or NULL when columns are given
+ *  @param	x	Column of n x values, used when pts is NULL
+ *  @param	y	win->y_count columns of n y values, used when pts is NULL
+ *  @param	n	Number of points
+ *  @param	ts	Send timestamp; 0 to leave it out
+ *  @param	win	Window the points belong to
+ *  @param	buf	Output buffer
+ *  @param	sz	Size of output buffer
+ *
+ *  @return	Encoded length if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_points_to_bin(const DataPoint *pts, const double *x, const double *const *y, int n,
+                       uint64_t ts, RTPS_Window *win, uint8_t *buf, size_t sz)
+{
+   if (win == NULL || buf == NULL || n < 0) return -1;
+   if (pts == NULL && (x == NULL || y == NULL)) return -1;
+   if (win->y_count < 0 || win->y_count > MAX_Y_PLOTS) return -2;
+
+   uint8_t flags = (ts != 0) ? RTPS_BIN_FLAG_TS : 0;
+   size_t len = RTPS_BIN_DATA_OFF(flags) + (size_t)n * RTPS_BIN_POINT_LEN(win->y_count);
+   if (len > sz) return -3;
+
+   RTPS_put_le16(buf+0, RTPS_BIN_MAGIC);
+   buf[2] = RTPS_BIN_VERSION;
+   buf[3] = RTPS_MSG_PLOT;
+   RTPS_put_le16(buf+4, (uint16_t)win->id);
+   buf[6] = (uint8_t)win->y_count;
+   buf[7] = flags;
+   RTPS_put_le32(buf+8, (uint32_t)n);
+   if (ts != 0) RTPS_put_le64(buf + RTPS_BIN_HDR_LEN, ts);
+
+   uint8_t *p = buf + RTPS_BIN_DATA_OFF(flags);
+   for (int i = 0; i < n; i++)
+   {
+      RTPS_put_f64(p, pts ? pts[i].x : x[i]);
+      for (int j = 0; j < win->y_count; j++)
+         RTPS_put_f64(p + 8*(j+1), pts ? pts[i].y[j] : y[j][i]);
+      p += RTPS_BIN_POINT_LEN(win->y_count);
+   }
+
+   return (int)len;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_bin_to_header(const uint8_t *buf, size_t len, RTPS_BinHeader *hdr)
+ *
+ *  @brief	Decode and validate a binary message header
+ *
+ *  @param	buf	Message bytes
+ *  @param	len	Message length
+ *  @param	hdr	Decoded header
+ *
+ *  @return	0 if the header is valid and the whole payload is present;
+ *              negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_bin_to_header(const uint8_t *buf, size_t len, RTPS_BinHeader *hdr)
+{
+   if (buf == NULL || hdr == NULL) return -1;
+   if (len < RTPS_BIN_HDR_LEN) return -2;
+
+   hdr->magic   = RTPS_get_le16(buf+0);
+   hdr->version = buf[2];
+   hdr->type    = buf[3];
+   hdr->window  = RTPS_get_le16(buf+4);
+   hdr->y_count = buf[6];
+   hdr->flags   = buf[7];
+   hdr->count   = RTPS_get_le32(buf+8);
+
+   if (hdr->magic != RTPS_BIN_MAGIC || hdr->version != RTPS_BIN_VERSION) return -3;
+   if (hdr->y_count > MAX_Y_PLOTS) return -4;
+   if (len < RTPS_BIN_DATA_OFF(hdr->flags)) return -5;
+   if ((len - RTPS_BIN_DATA_OFF(hdr->flags)) / RTPS_BIN_POINT_LEN(hdr->y_count) < hdr->count) return -5;
+
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_send_frame(int fd, const void *buf, size_t len)
+ *
+ *  @brief	Send one length-prefixed message, retrying short writes
+ *
+ *  @param	fd	Connected socket
+ *  @param	buf	Message payload
+ *  @param	len	Payload length
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_send_frame(int fd, const void *buf, size_t len)
+{
+   uint8_t hdr[RTPS_FRAME_HDR_LEN];
+   struct iovec iov[2];
+   struct msghdr msg = {0};
+
+   if (len > RTPS_MAX_FRAME_LEN) return -1;
+
+   RTPS_put_le32(hdr, (uint32_t)len);
+   iov[0].iov_base = hdr;
+   iov[0].iov_len  = sizeof(hdr);
+   iov[1].iov_base = (void *)buf;
+   iov[1].iov_len  = len;
+   msg.msg_iov     = iov;
+   msg.msg_iovlen  = 2;
+
+   while (msg.msg_iovlen > 0)
+   {
+      ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (n < 0)
+      {
+         if (errno == EINTR) continue;
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+         {
+            // Non-blocking socket with a full send buffer
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            if (poll(&pfd, 1, INGEST_POLL_MS) > 0) continue;
+         }
+         return -2;
+      }
+
+      // Skip what was written and resume inside a partially sent iovec
+      while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov[0].iov_len)
+      {
+         n -= msg.msg_iov[0].iov_len;
+         msg.msg_iov++;
+         msg.msg_iovlen--;
+      }
+      if (msg.msg_iovlen > 0)
+      {
+         msg.msg_iov[0].iov_base = (uint8_t *)msg.msg_iov[0].iov_base + n;
+         msg.msg_iov[0].iov_len -= n;
+      }
+   }
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_recv_frame(int fd, char *buf, size_t sz)
+ *
+ *  @brief	Block until one length-prefixed message is read
+ *
+ *  A message too large for buf is read and thrown away, so the next call starts
+ *  at the following message.
+ *
+ *  @param	fd	Connected socket
+ *  @param	buf	Output buffer; the payload is null-terminated
+ *  @param	sz	Size of output buffer
+ *
+ *  @return	Payload length if successful; -2 if the message was too large,
+ *              other negative values if the connection failed
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_recv_frame(int fd, char *buf, size_t sz)
+{
+   uint8_t hdr[RTPS_FRAME_HDR_LEN];
+
+   // Peek at the length, then take header and payload in one read, which on a
+   // packet socket is the whole packet
+   if (recv(fd, hdr, sizeof(hdr), MSG_WAITALL | MSG_PEEK) != sizeof(hdr)) return -1;
+
+   uint32_t len = RTPS_get_le32(hdr);
+   if (len >= sz)
+   {
+      int type = SOCK_STREAM;
+      socklen_t type_len = sizeof(type);
+      getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len);
+
+      // One read drops whatever of the packet does not fit
+      if (type == SOCK_SEQPACKET)
+         return (recv(fd, buf, sz, 0) < 0) ? -3 : -2;
+
+      for (size_t left = sizeof(hdr) + (size_t)len; left > 0; )
+      {
+         ssize_t n = recv(fd, buf, (left < sz) ? left : sz, MSG_WAITALL);
+         if (n <= 0) return -3;
+         left -= (size_t)n;
+      }
+      return -2;
+   }
+
+   struct iovec iov[2] = {
+      { .iov_base = hdr, .iov_len = sizeof(hdr) },
+      { .iov_base = buf, .iov_len = len }
+   };
+   struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+   if (recvmsg(fd, &msg, MSG_WAITALL) != (ssize_t)(sizeof(hdr) + len)) return -3;
+   buf[len] = '\0';
+
+   return (int)len;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_recv(int fd, RTPS_RxBuffer *rx, bool packet)
+ *
+ *  @brief      Append whatever the client has sent to its receive buffer
+ *
+ *  A packet socket is read one whole packet at a time; its size is peeked first
+ *  so the buffer can grow to hold it.
+ *
+ *  @param      fd              Client socket
+ *  @param      rx              Client receive buffer
+ *  @param      packet          fd is a SOCK_SEQPACKET socket
+ *
+ *  @return     Number of bytes read if success; negative if the connection is closed
+ *              or a packet is larger than a frame
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_recv(int fd, RTPS_RxBuffer *rx, bool packet)
+{
+   size_t want = RX_CHUNK_LEN;
+
+   if (packet)
+   {
+      ssize_t sz = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+      if (sz < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+         return 0;
+      if (sz <= 0 || (size_t)sz > RTPS_FRAME_HDR_LEN + RTPS_MAX_FRAME_LEN) return -2;
+      want = (size_t)sz;
+   }
+
+   // Keep at least one chunk of free space so a single read can pull many messages
+   if (rx->cap - rx->len < want)
+   {
+      size_t cap = (rx->cap > 0) ? rx->cap * 2 : RX_CHUNK_LEN * 2;
+      while (cap - rx->len < want) cap *= 2;
+
+      uint8_t *buf = realloc(rx->buf, cap);
+      if (buf == NULL) return -1;
+      rx->buf = buf;
+      rx->cap = cap;
+   }
+
+   ssize_t valread = recv(fd, rx->buf + rx->len, rx->cap - rx->len, 0);
+   if (valread > 0)
+   {
+      rx->len += valread;
+      return (int)valread;
+   }
+   if (valread < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+      return 0;
+
+   return -2;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_next_frame(RTPS_RxBuffer *rx, size_t *pos,
+ *                                         uint8_t **payload, size_t *len)
+ *
+ *  @brief      Extract the next complete message from a receive buffer
+ *
+ *  @param      rx              Receive buffer
+ *  @param      pos             Read position; advanced past the message
+ *  @param      payload         Set to the start of the message payload
+ *  @param      len             Set to the payload length
+ *
+ *  @return     1 if a message was extracted, 0 if more data is needed,
+ *              negative if the stream is corrupt
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_next_frame(RTPS_RxBuffer *rx, size_t *pos, uint8_t **payload, size_t *len)
+{
+   size_t avail = rx->len - *pos;
+
+   if (avail < RTPS_FRAME_HDR_LEN) return 0;
+
+   uint32_t flen = RTPS_get_le32(rx->buf + *pos);
+   if (flen > RTPS_MAX_FRAME_LEN) return -1;
+   if (avail - RTPS_FRAME_HDR_LEN < flen) return 0;
+
+   *payload = rx->buf + *pos + RTPS_FRAME_HDR_LEN;
+   *len = flen;
+   *pos += RTPS_FRAME_HDR_LEN + flen;
+   return 1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_perror(char *msg)
+ *
+ *  @brief	Print error message
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_perror(char *msg)
+{
+   printf("Error: %s\n", msg);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_is_all_digits(const char *str) 
+ *
+ *  @brief 	 Returns 1 if str is made only of digits, 0 otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_is_all_digits(const char *str) 
+{
+   if (!str || !*str) return 0; // Empty string or NULL is not valid
+
+   for (; *str; ++str) 
+   {
+      if (!isdigit((unsigned char)*str)) 
+         return 0;
+   }
+   return 1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_unix_endpoint(const char *endpoint, struct sockaddr_un *addr, int *type)
+ *
+ *  @brief	Parse a "unix:/path" or "unixpacket:/path" endpoint
+ *
+ *  @param	endpoint	Endpoint string
+ *  @param	addr		Socket address to fill in
+ *  @param	type		SOCK_STREAM or SOCK_SEQPACKET
+ *
+ *  @return	1 if endpoint is a Unix domain socket; 0 if not; negative if the path
+ *              is empty or too long
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_unix_endpoint(const char *endpoint, struct sockaddr_un *addr, int *type)
+{
+   const char *path;
+
+   if (0 == strncmp(endpoint, "unix:", 5))
+   {
+      path = endpoint + 5;
+      *type = SOCK_STREAM;
+   }
+   else if (0 == strncmp(endpoint, "unixpacket:", 11))
+   {
+      path = endpoint + 11;
+      *type = SOCK_SEQPACKET;
+   }
+   else
+   {
+      return 0;
+   }
+
+   if (path[0] == '\0' || strlen(path) >= sizeof(addr->sun_path)) return -1;
+
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+   strcpy(addr->sun_path, path);
+   return 1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *  
+ *  @fn		RTPS_Connection *RTPS_connect(char *ipaddr, int port)
+ *
+ *  @brief	Connect to a Real-Time Plot Server at <ipaddr:port>
+ *
+ *  @param	ipaddr	        IP address where the RTPS server is running	
+ *  @param	port	 	Port at which RTPS is listening	
+ *
+ *  @return	RTPS_Connection pointer if successful, otherwise NULL 
+ *
+ *---------------------------------------------------------------------------------------
+ */
+RTPS_Connection *RTPS_connect(char *ipaddr, int port)
+{
+    RTPS_Connection *conn = NULL;
+    
+    if (ipaddr == NULL) 
+    {
+       RTPS_perror("IP address is NULL");
+       goto _err_ret;
+    }
+
+    conn = (RTPS_Connection *)calloc(1, sizeof(RTPS_Connection));
+    if (conn != NULL) 
     {
        conn->connected = false;
+       conn->encoding = RTPS_ENCODING_JSON;
+       conn->req_encoding = RTPS_ENCODING_JSON;
+       conn->client = -1;
+       conn->tx = (RTPS_TxBuffer){0};
+       conn->async = NULL;
+       conn->udp_fd = -1;
+       conn->type = SOCK_STREAM;
+       conn->max_msg = RTPS_FRAME_HDR_LEN + RTPS_MAX_FRAME_LEN;
+
+       // Unix domain socket on this host
+       int local = RTPS_unix_endpoint(ipaddr, &conn->unix_address, &conn->type);
+       if (local < 0)
+       {
+          RTPS_perror("Bad socket path");
+          goto _err_ret;
+       }
+       if (local > 0)
+       {
+          conn->fd = socket(AF_UNIX, conn->type | SOCK_CLOEXEC, 0);
+          if (conn->fd < 0)
+          {
+             RTPS_perror("Socket creation failed");
+             goto _err_ret;
+          }
+
+          // Every write is one packet
+          if (conn->type == SOCK_SEQPACKET)
+          {
+             int sndbuf = 2 * UNIX_PACKET_LEN;
+             setsockopt(conn->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+             conn->max_msg = UNIX_PACKET_LEN;
+          }
+
+          if (connect(conn->fd, (struct sockaddr *)&conn->unix_address, sizeof(conn->unix_address)) < 0)
+          {
+             RTPS_perror("Connection failed");
+             close(conn->fd);
+             goto _err_ret;
+          }
+          return conn;
+       }
+
        conn->fd = socket(AF_INET, SOCK_STREAM, 0);
        if (conn->fd < 0)
        {
@@ -547,68 +1485,3352 @@ RTPS_Connection *RTPS_connect(char *ipaddr, int port)
        return conn;
     }
 
-_err_ret:
-    if (conn != NULL) free(conn);
-    return NULL;
-} 
+_err_ret:
+    if (conn != NULL) free(conn);
+    return NULL;
+} 
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_disconnect(RTPS_Connection *conn)
+ *
+ *  @brief	Disconnect from RTPS
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_disconnect(RTPS_Connection *conn)
+{
+   if (conn != NULL)
+   {
+      RTPS_client_stop_async(conn);
+      if (conn->client >= 0 && conn->client != conn->fd) close(conn->client);
+      if (conn->udp_fd >= 0) close(conn->udp_fd);
+      if (conn->fd >= 0) close(conn->fd);
+      if (conn->listening && conn->unix_address.sun_family == AF_UNIX)
+         unlink(conn->unix_address.sun_path);
+      free(conn->tx.buf);
+      conn->tx = (RTPS_TxBuffer){0};
+      conn->fd = -1;
+      conn->client = -1;
+      conn->udp_fd = -1;
+      conn->listening = false;
+      conn->connected = false;
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_set_encoding(RTPS_Connection *conn, int encoding)
+ *
+ *  @brief	Request an encoding for "plot" data
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	encoding	RTPS_ENCODING_JSON or RTPS_ENCODING_BINARY
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_set_encoding(RTPS_Connection *conn, int encoding)
+{
+   if (conn == NULL) return -1;
+   if (encoding != RTPS_ENCODING_JSON && encoding != RTPS_ENCODING_BINARY) return -2;
+
+   conn->req_encoding = encoding;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_set_timestamps(RTPS_Connection *conn, bool on)
+ *
+ *  @brief	Stamp every batch of "plot" data with its send time
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	on		true to stamp, false to stop
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_set_timestamps(RTPS_Connection *conn, bool on)
+{
+   if (conn == NULL) return -1;
+
+   conn->stamp = on;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		size_t RTPS_async_limit(const RTPS_Connection *conn)
+ *
+ *  @brief	Bytes of queued rows gathered per write
+ *
+ *  A packet socket sends the gathered frames as one packet, so the rows are held to
+ *  a fraction of the packet size that leaves room for their JSON form.
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+size_t RTPS_async_limit(const RTPS_Connection *conn)
+{
+   return (conn->max_msg < CLIENT_TX_LEN) ? conn->max_msg / 5 : CLIENT_TX_LEN;
+}
+
+
+// Record in the async send queue, followed by count points in wire format
+typedef struct {
+   uint16_t window;
+   uint8_t y_count;
+   uint8_t reserved;
+   uint32_t count;
+   uint64_t sent_ns;            // enqueue time with timestamps on, else 0
+}
+RTPS_TxRecord;
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_enqueue(RTPS_Connection *conn, RTPS_Window *win,
+ *                                      const DataPoint *pts, const double *x,
+ *                                      const double *const *y, int n)
+ *
+ *  @brief	Copy a batch of points, given as rows or columns, into the send queue
+ *
+ *  Never blocks: if the queue is full the points are dropped and counted.
+ *
+ *  @return	0 if queued; -4 if the connection broke; -5 if too large for one
+ *              packet; -6 if dropped
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_client_enqueue(RTPS_Connection *conn, RTPS_Window *win,
+                        const DataPoint *pts, const double *x, const double *const *y, int n)
+{
+   RTPS_ClientAsync *as = conn->async;
+
+   if (atomic_load(&as->failed)) return -4;
+
+   size_t row = RTPS_BIN_POINT_LEN(win->y_count);
+   if (conn->type == SOCK_SEQPACKET && (size_t)n * row > RTPS_async_limit(conn)) return -5;
+
+   size_t len = sizeof(RTPS_TxRecord) + (size_t)n * row;
+   RTPS_TxRecord *rec = spsc_reserve(as->queue, len);
+   if (rec == NULL)
+   {
+      atomic_fetch_add(&as->dropped, n);
+      return -6;
+   }
+
+   rec->window = (uint16_t)win->id;
+   rec->y_count = (uint8_t)win->y_count;
+   rec->reserved = 0;
+   rec->count = (uint32_t)n;
+   rec->sent_ns = conn->stamp ? RTPS_clock_ns() : 0;
+
+   uint8_t *p = (uint8_t *)(rec + 1);
+   for (int i = 0; i < n; i++)
+   {
+      RTPS_put_f64(p, pts ? pts[i].x : x[i]);
+      for (int j = 0; j < win->y_count; j++)
+         RTPS_put_f64(p + 8*(j+1), pts ? pts[i].y[j] : y[j][i]);
+      p += row;
+   }
+
+   spsc_commit(as->queue, len);
+   atomic_fetch_add(&as->queued, n);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_async_fill(RTPS_Connection *conn)
+ *
+ *  @brief	Move queued points into the transmit buffer as framed "plot" messages
+ *
+ *  Consecutive records for the same window become one message, stamped with the
+ *  first record's time; messages are gathered until about RTPS_async_limit() bytes
+ *  are pending so they go out in a single write.
+ *
+ *  @return	Number of points moved; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_async_fill(RTPS_Connection *conn)
+{
+   RTPS_ClientAsync *as = conn->async;
+   RTPS_TxBuffer *tx = &as->tx;
+   RTPS_TxRecord *rec;
+   size_t limit = RTPS_async_limit(conn);
+   int moved = 0;
+
+   while (tx->len < limit && (rec = spsc_peek(as->queue, NULL)) != NULL)
+   {
+      RTPS_Window win;
+      win.id = rec->window;
+      win.y_count = rec->y_count;
+
+      size_t row = RTPS_BIN_POINT_LEN(win.y_count);
+      uint64_t ts = rec->sent_ns;
+      uint8_t flags = (ts != 0) ? RTPS_BIN_FLAG_TS : 0;
+      size_t start = tx->len;
+      size_t body = start + RTPS_FRAME_HDR_LEN + RTPS_BIN_DATA_OFF(flags);
+      if (RTPS_tx_reserve(tx, body - start) < 0) return -1;
+      tx->len = body;
+
+      // Rows are copied as they are; consecutive records of this window are merged
+      uint32_t n = 0;
+      while (rec != NULL && rec->window == win.id && rec->y_count == win.y_count &&
+             (n == 0 || tx->len + rec->count * row <= limit))
+      {
+         if (RTPS_tx_reserve(tx, rec->count * row) < 0) return -1;
+         memcpy(tx->buf + tx->len, rec + 1, rec->count * row);
+         tx->len += rec->count * row;
+         n += rec->count;
+         spsc_release(as->queue);
+         rec = spsc_peek(as->queue, NULL);
+      }
+
+      if (conn->encoding == RTPS_ENCODING_BINARY)
+      {
+         uint8_t *hdr = tx->buf + start + RTPS_FRAME_HDR_LEN;
+         RTPS_put_le32(tx->buf + start, (uint32_t)(tx->len - start - RTPS_FRAME_HDR_LEN));
+         RTPS_put_le16(hdr+0, RTPS_BIN_MAGIC);
+         hdr[2] = RTPS_BIN_VERSION;
+         hdr[3] = RTPS_MSG_PLOT;
+         RTPS_put_le16(hdr+4, (uint16_t)win.id);
+         hdr[6] = (uint8_t)win.y_count;
+         hdr[7] = flags;
+         RTPS_put_le32(hdr+8, n);
+         if (ts != 0) RTPS_put_le64(hdr + RTPS_BIN_HDR_LEN, ts);
+      }
+      else
+      {
+         // Decode the rows again and replace them with the JSON message
+         if (n > as->rows_cap)
+         {
+            DataPoint *rows = realloc(as->rows, n * sizeof(DataPoint));
+            if (rows == NULL) return -1;
+            as->rows = rows;
+            as->rows_cap = n;
+         }
+         for (uint32_t i = 0; i < n; i++)
+         {
+            const uint8_t *p = tx->buf + body + i * row;
+            as->rows[i].x = RTPS_get_f64(p);
+            for (int j = 0; j < win.y_count; j++)
+               as->rows[i].y[j] = RTPS_get_f64(p + 8*(j+1));
+         }
+
+         tx->len = start + RTPS_FRAME_HDR_LEN;
+         int len = RTPS_points_to_json(as->rows, NULL, NULL, n, true, ts, &win, tx);
+         if (len < 0) return -1;
+         RTPS_put_le32(tx->buf + start, (uint32_t)len);
+      }
+
+      as->tx_points += n;
+      moved += n;
+   }
+   return moved;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_async_drain(RTPS_Connection *conn, bool wait)
+ *
+ *  @brief	Write queued data until the queue is empty
+ *
+ *  Short writes resume where they stopped. When the socket is full the call either
+ *  returns or, with wait, polls for room.
+ *
+ *  @param	conn	RTPS_Connection in async mode
+ *  @param	wait	Wait for the socket instead of returning when it is full
+ *
+ *  @return	0 if everything was written; 1 if data remains; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_async_drain(RTPS_Connection *conn, bool wait)
+{
+   RTPS_ClientAsync *as = conn->async;
+
+   if (atomic_load(&as->failed)) return -1;
+
+   for (;;)
+   {
+      if (as->tx_off < as->tx.len)
+      {
+         ssize_t n = send(conn->fd, as->tx.buf + as->tx_off, as->tx.len - as->tx_off,
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+         if (n > 0)
+         {
+            as->tx_off += n;
+            continue;
+         }
+         if (n < 0 && errno == EINTR) continue;
+         if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         {
+            atomic_fetch_add(&as->blocked, 1);
+            if (!wait) return 1;
+
+            struct pollfd pfd = { .fd = conn->fd, .events = POLLOUT };
+            poll(&pfd, 1, INGEST_POLL_MS);
+            if (as->threaded && !atomic_load(&as->running)) return 1;
+            continue;
+         }
+         atomic_store(&as->failed, true);
+         atomic_store(&as->busy, false);
+         return -2;
+      }
+
+      // Everything pending is out
+      atomic_fetch_add(&as->sent, as->tx_points);
+      as->tx_points = 0;
+      as->tx.len = as->tx_off = 0;
+
+      atomic_store(&as->busy, true);
+      if (spsc_empty(as->queue))
+      {
+         atomic_store(&as->busy, false);
+         return 0;
+      }
+      if (RTPS_async_fill(conn) < 0)
+      {
+         atomic_store(&as->failed, true);
+         atomic_store(&as->busy, false);
+         return -3;
+      }
+   }
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void *RTPS_client_sender(void *arg)
+ *
+ *  @brief	Sender thread: drain the queue until stopped or the connection breaks
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void *RTPS_client_sender(void *arg)
+{
+   RTPS_Connection *conn = (RTPS_Connection *)arg;
+   RTPS_ClientAsync *as = conn->async;
+
+   while (atomic_load(&as->running))
+   {
+      int rc = RTPS_async_drain(conn, true);
+      if (rc < 0) break;
+      if (rc == 0) usleep(CLIENT_TX_IDLE_US);
+   }
+   return NULL;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_start_async(RTPS_Connection *conn, size_t queue_len,
+ *                                          bool thread)
+ *
+ *  @brief	Queue "plot" data instead of sending it from the calling thread
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	queue_len	Queue size in bytes; 0 for CLIENT_QUEUE_LEN
+ *  @param	thread		Start a sender thread rather than rely on polling
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_start_async(RTPS_Connection *conn, size_t queue_len, bool thread)
+{
+   RTPS_ClientAsync *as = NULL;
+
+   if (conn == NULL) return -1;
+   if (conn->async != NULL) return -2;
+
+   if ((as = calloc(1, sizeof(RTPS_ClientAsync))) == NULL) goto _err_ret;
+   if ((as->queue = spsc_create(queue_len ? queue_len : CLIENT_QUEUE_LEN)) == NULL) goto _err_ret;
+   if (RTPS_tx_reserve(&as->tx, CLIENT_TX_LEN) < 0) goto _err_ret;
+   as->threaded = thread;
+   atomic_init(&as->running, true);
+   atomic_init(&as->busy, false);
+   atomic_init(&as->failed, false);
+   conn->async = as;
+
+   if (thread && pthread_create(&as->thread, NULL, RTPS_client_sender, conn) != 0)
+   {
+      conn->async = NULL;
+      goto _err_ret;
+   }
+   return 0;
+
+_err_ret:
+   if (as != NULL)
+   {
+      spsc_free(as->queue);
+      free(as->tx.buf);
+      free(as);
+   }
+   return -3;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_poll(RTPS_Connection *conn)
+ *
+ *  @brief	Write as much queued data as the socket takes, without blocking
+ *
+ *  @return	0 if everything was written; 1 if data remains; negative on error
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_poll(RTPS_Connection *conn)
+{
+   if (conn == NULL || conn->async == NULL) return -1;
+   if (conn->async->threaded) return -2;
+
+   int rc = RTPS_async_drain(conn, false);
+   return (rc < 0) ? -3 : rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_flush(RTPS_Connection *conn)
+ *
+ *  @brief	Block until all queued data is written
+ *
+ *  Returns at once if conn is not in async mode.
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_flush(RTPS_Connection *conn)
+{
+   if (conn == NULL) return -1;
+
+   RTPS_ClientAsync *as = conn->async;
+   if (as == NULL) return 0;
+
+   if (!as->threaded)
+      return (RTPS_async_drain(conn, true) < 0) ? -2 : 0;
+
+   // The sender marks itself busy before it takes anything from the queue
+   while (!spsc_empty(as->queue) || atomic_load(&as->busy))
+   {
+      if (atomic_load(&as->failed)) return -2;
+      usleep(CLIENT_TX_IDLE_US);
+   }
+   return atomic_load(&as->failed) ? -2 : 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_client_stop_async(RTPS_Connection *conn)
+ *
+ *  @brief	Flush the queue, stop the sender and go back to sending directly
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_client_stop_async(RTPS_Connection *conn)
+{
+   if (conn == NULL || conn->async == NULL) return;
+
+   RTPS_ClientAsync *as = conn->async;
+   RTPS_client_flush(conn);
+   if (as->threaded)
+   {
+      atomic_store(&as->running, false);
+      pthread_join(as->thread, NULL);
+   }
+
+   conn->async = NULL;
+   spsc_free(as->queue);
+   free(as->tx.buf);
+   free(as->rows);
+   free(as);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_get_stats(RTPS_Connection *conn, RTPS_ClientStats *stats)
+ *
+ *  @brief	Read the send queue counters
+ *
+ *  @return	0 if successful; negative if conn is not in async mode
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_get_stats(RTPS_Connection *conn, RTPS_ClientStats *stats)
+{
+   if (conn == NULL || conn->async == NULL || stats == NULL) return -1;
+
+   stats->queued  = atomic_load(&conn->async->queued);
+   stats->sent    = atomic_load(&conn->async->sent);
+   stats->dropped = atomic_load(&conn->async->dropped);
+   stats->blocked = atomic_load(&conn->async->blocked);
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_enable_udp(RTPS_Connection *conn)
+ *
+ *  @brief	Send plot data as UDP datagrams to the server's port
+ *
+ *  @param	conn		RTPS_Connection
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_enable_udp(RTPS_Connection *conn)
+{
+   if (conn == NULL) return -1;
+   if (conn->udp_fd >= 0) return 0;
+   if (conn->unix_address.sun_family == AF_UNIX) return -5;
+
+   // Keep the order of anything queued before this
+   if (RTPS_client_flush(conn) < 0) return -2;
+
+   int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+   if (fd < 0) return -3;
+
+   if (connect(fd, (struct sockaddr *)&conn->address, sizeof(conn->address)) < 0)
+   {
+      close(fd);
+      return -4;
+   }
+   conn->udp_fd = fd;
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_udp_send(RTPS_Connection *conn, RTPS_Window *win, const DataPoint *pts,
+ *                                const double *x, const double *const *y, int n, uint64_t ts)
+ *
+ *  @brief	Send a batch of points, given as rows or columns, as datagrams
+ *
+ *  Never blocks. A datagram the socket cannot take is dropped but still uses up
+ *  its sequence number, so the server sees the loss.
+ *
+ *  @return	0 if sent; -4 on socket error; -6 if some points were dropped
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_udp_send(RTPS_Connection *conn, RTPS_Window *win, const DataPoint *pts,
+                  const double *x, const double *const *y, int n, uint64_t ts)
+{
+   const double *yo[MAX_Y_PLOTS];
+   int max = (RTPS_UDP_MAX_LEN - RTPS_UDP_HDR_LEN - RTPS_BIN_DATA_OFF(ts ? RTPS_BIN_FLAG_TS : 0)) /
+             RTPS_BIN_POINT_LEN(win->y_count);
+   int rc = 0;
+
+   if (RTPS_tx_reserve(&conn->tx, RTPS_UDP_MAX_LEN) < 0) return -2;
+
+   for (int off = 0, k; off < n; off += k)
+   {
+      k = (n - off < max) ? n - off : max;
+      for (int j = 0; j < win->y_count && y != NULL; j++)
+         yo[j] = y[j] + off;
+
+      RTPS_put_le32(conn->tx.buf, win->udp_seq++);
+      int len = RTPS_points_to_bin(pts ? pts + off : NULL, x ? x + off : NULL, y ? yo : NULL, k,
+                                   ts, win, conn->tx.buf + RTPS_UDP_HDR_LEN,
+                                   conn->tx.cap - RTPS_UDP_HDR_LEN);
+      if (len < 0) return -3;
+
+      if (send(conn->udp_fd, conn->tx.buf, RTPS_UDP_HDR_LEN + len, MSG_DONTWAIT) < 0)
+      {
+         if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) return -4;
+         rc = -6;
+      }
+   }
+
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_shm_put(RTPS_Window *win, const DataPoint *pts, const double *x,
+ *                               const double *const *y, int n, uint64_t ts)
+ *
+ *  @brief	Write a batch of points, given as rows or columns, into the window's
+ *              shared-memory ring
+ *
+ *  Records hold the send timestamp (0 if none) followed by the same columns as a
+ *  queued plot event: count x values, then count values of each series.
+ *
+ *  @return	0 if written; -6 if the ring was full and the rest was dropped
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_shm_put(RTPS_Window *win, const DataPoint *pts, const double *x,
+                 const double *const *y, int n, uint64_t ts)
+{
+   int y_count = win->y_count;
+
+   // Largest record the ring accepts
+   int max = (win->shm->sz / 2 - SPSC_REC_HDR_LEN - sizeof(uint64_t)) / RTPS_PLOT_EVENT_LEN(1, y_count);
+   if (max > EVENT_MAX_POINTS) max = EVENT_MAX_POINTS;
+
+   for (int off = 0; off < n; )
+   {
+      int k = (n - off < max) ? n - off : max;
+      uint64_t *rec = spsc_reserve(win->shm, sizeof(uint64_t) + RTPS_PLOT_EVENT_LEN(k, y_count));
+      if (rec == NULL) return -6;
+      rec[0] = ts;
+
+      double *col = (double *)(rec + 1);
+      if (pts != NULL)
+      {
+         for (int i = 0; i < k; i++)
+         {
+            col[i] = pts[off+i].x;
+            for (int j = 0; j < y_count; j++)
+               col[(j+1)*k + i] = pts[off+i].y[j];
+         }
+      }
+      else
+      {
+         memcpy(col, x + off, k * sizeof(double));
+         for (int j = 0; j < y_count; j++)
+            memcpy(col + (j+1)*k, y[j] + off, k * sizeof(double));
+      }
+      spsc_commit(win->shm, sizeof(uint64_t) + RTPS_PLOT_EVENT_LEN(k, y_count));
+      off += k;
+   }
+
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_send_points(RTPS_Connection *conn, RTPS_Window *win,
+ *                                          const DataPoint *pts, const double *x,
+ *                                          const double *const *y, int n, bool nested)
+ *
+ *  @brief	Send a batch of points, given as rows or columns, in one message
+ *
+ *  The message is encoded into the connection's buffer and written with the frame
+ *  header in one sendmsg(); nothing is allocated once the buffer has grown to size.
+ *
+ *  @param	nested	JSON only: send "data" as an array of points even if n is 1
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_client_send_points(RTPS_Connection *conn, RTPS_Window *win,
+                            const DataPoint *pts, const double *x, const double *const *y, int n,
+                            bool nested)
+{
+   int len;
+
+   if (conn == NULL || win == NULL || n <= 0) return -1;
+   if (win->y_count < 0 || win->y_count > MAX_Y_PLOTS) return -2;
+
+   uint64_t ts = conn->stamp ? RTPS_clock_ns() : 0;
+
+   if (win->shm != NULL)
+      return RTPS_shm_put(win, pts, x, y, n, ts);
+
+   if (conn->udp_fd >= 0)
+      return RTPS_udp_send(conn, win, pts, x, y, n, ts);
+
+   if (conn->async != NULL)
+      return RTPS_client_enqueue(conn, win, pts, x, y, n);
+
+   conn->tx.len = 0;
+   if (conn->encoding == RTPS_ENCODING_BINARY)
+   {
+      size_t sz = RTPS_BIN_DATA_OFF(ts ? RTPS_BIN_FLAG_TS : 0) + (size_t)n * RTPS_BIN_POINT_LEN(win->y_count);
+      if (RTPS_FRAME_HDR_LEN + sz > conn->max_msg) return -5;
+      if (RTPS_tx_reserve(&conn->tx, sz) < 0) return -2;
+
+      len = RTPS_points_to_bin(pts, x, y, n, ts, win, conn->tx.buf, conn->tx.cap);
+   }
+   else
+   {
+      len = RTPS_points_to_json(pts, x, y, n, nested, ts, win, &conn->tx);
+      if (len >= 0 && RTPS_FRAME_HDR_LEN + (size_t)len > conn->max_msg) return -5;
+   }
+   if (len < 0) return -3;
+
+   return (RTPS_send_frame(conn->fd, conn->tx.buf, len) < 0) ? -4 : 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_send(RTPS_Connection *conn, 
+ *                                   RTPS_Window *win, 
+ *                                   DataPoint *data)
+ *
+ *  @brief	Send a DataPoint 
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	win		Pointer to RTPS_Window 
+ *  @param	data		Pointer to DataPoint
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_send(RTPS_Connection *conn, RTPS_Window *win, DataPoint *data)
+{
+   if (data == NULL) return -1;
+   return RTPS_client_send_points(conn, win, data, NULL, NULL, 1, false);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_send_batch(RTPS_Connection *conn, RTPS_Window *win,
+ *                                         const DataPoint *data, int n)
+ *
+ *  @brief	Send an array of DataPoint in one message
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	win		Pointer to RTPS_Window 
+ *  @param	data		Array of n DataPoint
+ *  @param	n		Number of points
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_send_batch(RTPS_Connection *conn, RTPS_Window *win, const DataPoint *data, int n)
+{
+   if (data == NULL) return -1;
+   return RTPS_client_send_points(conn, win, data, NULL, NULL, n, true);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_send_columns(RTPS_Connection *conn, RTPS_Window *win,
+ *                                           const double *x, const double *const *y, int n)
+ *
+ *  @brief	Send a columnar block of points in one message
+ *
+ *  @param	conn		RTPS_Connection
+ *  @param	win		Pointer to RTPS_Window 
+ *  @param	x		n x values
+ *  @param	y		win->y_count pointers to n y values each
+ *  @param	n		Number of points
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_send_columns(RTPS_Connection *conn, RTPS_Window *win,
+                             const double *x, const double *const *y, int n)
+{
+   if (x == NULL || y == NULL) return -1;
+   return RTPS_client_send_points(conn, win, NULL, x, y, n, true);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_recv_ack(RTPS_Connection *conn, RTPS_Window *plot)
+ *  
+ *  @brief	Wait for the server's reply to "create" and apply the negotiated encoding
+ *
+ *  @param	conn		Instantiated RTPS_Connection pointer
+ *  @param	plot		Window that receives the assigned handle
+ *
+ *  @return	0 if the server accepted the window; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_client_recv_ack(RTPS_Connection *conn, RTPS_Window *plot)
+{
+   int rc = -1;
+   cJSON *root, *status, *enc, *id;
+   char message[MAX_JSON_LEN];
+
+   if (RTPS_recv_frame(conn->fd, message, sizeof(message)) < 0) return -2;
+
+   if ((root = cJSON_Parse(message)) == NULL) return -3;
+
+   if ((status = cJSON_extract(root, 'n', "status")) != NULL && status->valueint == 0 &&
+       (id = cJSON_extract(root, 'n', "window")) != NULL)
+   {
+      plot->id = id->valueint;
+      conn->encoding = RTPS_ENCODING_JSON;
+      if ((enc = cJSON_extract(root, 's', "encoding")) != NULL &&
+          0 == strcmp(enc->valuestring, "binary"))
+      {
+         conn->encoding = RTPS_ENCODING_BINARY;
+      }
+      rc = 0;
+   }
+   cJSON_Delete(root);
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_create_plot(RTPS_Connection *conn, RTPS_Window *plot)
+ *  
+ *  @brief	Initialize plot
+ *
+ *  @param	conn		Instantiated RTPS_Connection pointer
+ *  @param	plot		Instantiated RTPS_Window pointer
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_create_plot(RTPS_Connection *conn, RTPS_Window *plot)
+{
+   int rc = -1;
+   if (conn == NULL || plot == NULL) goto _err_ret; 
+
+   // Keep the order of anything queued before this
+   if (RTPS_client_flush(conn) < 0) goto _err_ret;
+
+   cJSON *root = cJSON_CreateObject();
+   if (root != NULL)
+   {
+      if (0 == RTPS_win_to_cjson(plot, root))
+      {
+         if (conn->req_encoding == RTPS_ENCODING_BINARY)
+            cJSON_AddStringToObject(root, "encoding", "binary");
+
+         char *json_str = cJSON_Print(root);
+         if (json_str != NULL)
+         {
+            if (RTPS_send_frame(conn->fd, json_str, strlen(json_str)) == 0)
+               rc = RTPS_client_recv_ack(conn, plot);
+            free(json_str);
+         }
+      }
+      cJSON_Delete(root);
+   }
+
+_err_ret:
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_destroy_plot(RTPS_Connection *conn, RTPS_Window *plot)
+ *  
+ *  @brief	Close a window created with RTPS_client_create_plot()
+ *
+ *  @param	conn		Instantiated RTPS_Connection pointer
+ *  @param	plot		RTPS_Window holding the handle to close
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_destroy_plot(RTPS_Connection *conn, RTPS_Window *plot)
+{
+   char message[MAX_JSON_LEN];
+
+   if (conn == NULL || plot == NULL) return -1;
+   if (RTPS_client_flush(conn) < 0) return -3;
+
+   // The server drains what is left in the ring before closing the window
+   if (plot->shm != NULL)
+   {
+      munmap(plot->shm, plot->shm_len);
+      plot->shm = NULL;
+      plot->shm_len = 0;
+   }
+
+   int len = snprintf(message, sizeof(message), "{\"cmd\":\"destroy\",\"window\":%d}", plot->id);
+   if (len < 0 || len >= (int)sizeof(message)) return -2;
+
+   return (RTPS_send_frame(conn->fd, message, len) < 0) ? -3 : 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_attach_shm(RTPS_Connection *conn, RTPS_Window *win, size_t len)
+ *  
+ *  @brief	Send the plot data of a window through a shared-memory ring
+ *
+ *  The ring is created under a unique name, announced with an "attach" command and
+ *  unlinked once the server has answered; from then on only the two mappings keep
+ *  it alive. The server only maps rings for clients on its own host, connected
+ *  through a unix socket or loopback, and owned by the same user as the client.
+ *
+ *  @param	conn		Instantiated RTPS_Connection pointer
+ *  @param	win		Window created with RTPS_client_create_plot()
+ *  @param	len		Ring size in bytes, or 0 for CLIENT_SHM_LEN
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_attach_shm(RTPS_Connection *conn, RTPS_Window *win, size_t len)
+{
+   static atomic_uint seq;
+   char name[MAX_STR_LEN];
+   char message[MAX_JSON_LEN];
+   int rc = -1;
+   void *mem = MAP_FAILED;
+   cJSON *root, *status;
+
+   if (conn == NULL || win == NULL) return -1;
+   if (win->shm != NULL) return -2;
+   if (len == 0) len = CLIENT_SHM_LEN;
+   if (len < 64 * 1024) len = 64 * 1024;        // room for records of many points
+
+   // Keep the order of anything queued before this
+   if (RTPS_client_flush(conn) < 0) return -3;
+
+   snprintf(name, sizeof(name), "/rtps-%d-%d-%u", (int)getpid(), win->id, atomic_fetch_add(&seq, 1));
+   int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd < 0) return -4;
+
+   if (ftruncate(fd, len) == 0)
+      mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) goto _err_ret;
+
+   SpscRing *ring = spsc_init(mem, len);
+
+   int n = snprintf(message, sizeof(message), "{\"cmd\":\"attach\",\"window\":%d,\"shm\":\"%s\"}",
+                    win->id, name);
+   if (ring == NULL || n < 0 || n >= (int)sizeof(message)) goto _err_ret;
+
+   if (RTPS_send_frame(conn->fd, message, n) < 0 ||
+       RTPS_recv_frame(conn->fd, message, sizeof(message)) < 0)
+   {
+      rc = -5;
+      goto _err_ret;
+   }
+
+   rc = -6;
+   if ((root = cJSON_Parse(message)) != NULL)
+   {
+      if ((status = cJSON_extract(root, 'n', "status")) != NULL && status->valueint == 0)
+         rc = 0;
+      cJSON_Delete(root);
+   }
+
+_err_ret:
+   shm_unlink(name);
+   if (rc == 0)
+   {
+      win->shm = ring;
+      win->shm_len = len;
+   }
+   else if (mem != MAP_FAILED)
+   {
+      munmap(mem, len);
+   }
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_client_query_stats(RTPS_Connection *conn, char **json)
+ *  
+ *  @brief	Ask the server for its counters and gauges
+ *
+ *  The reply can be any size, so its buffer is allocated once the length is known.
+ *
+ *  @param	conn		Instantiated RTPS_Connection pointer
+ *  @param	json		Receives the reply, null-terminated; free() it when done
+ *
+ *  @return	0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_client_query_stats(RTPS_Connection *conn, char **json)
+{
+   static const char request[] = "{\"cmd\":\"stats\"}";
+   uint8_t hdr[RTPS_FRAME_HDR_LEN];
+
+   if (conn == NULL || json == NULL) return -1;
+   *json = NULL;
+
+   // Keep the order of anything queued before this
+   if (RTPS_client_flush(conn) < 0) return -2;
+
+   if (RTPS_send_frame(conn->fd, request, sizeof(request) - 1) < 0) return -3;
+   if (recv(conn->fd, hdr, sizeof(hdr), MSG_WAITALL | MSG_PEEK) != sizeof(hdr)) return -4;
+
+   size_t len = RTPS_get_le32(hdr);
+   if (len > RTPS_MAX_FRAME_LEN || (*json = malloc(len + 1)) == NULL) return -5;
+
+   if (RTPS_recv_frame(conn->fd, *json, len + 1) < 0)
+   {
+      free(*json);
+      *json = NULL;
+      return -4;
+   }
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_win_check(const RTPS_Window *window)
+ *
+ *  @brief      Validate a parsed window configuration
+ *
+ *  return       0 valid
+ *              -16 y_count out of range
+ *              -17 no room for the plot area between the margins
+ *              -18 a step or range that is not positive, or y_max not above y_min
+ *              -19 more than MAX_WINDOW_POINTS points in x_range
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_win_check(const RTPS_Window *window)
+{
+   if (window->y_count < 0 || window->y_count > MAX_Y_PLOTS) return -16;
+   if (window->width <= PLOT_MARGIN_LEFT + PLOT_MARGIN_RIGHT ||
+       window->height <= PLOT_MARGIN_TOP + PLOT_MARGIN_BOTTOM) return -17;
+
+   // Written so that NaN fails too
+   if (!(window->x_step > 0) || !(window->x_range > 0) ||
+       !(window->x_grid_step > 0) || !(window->y_grid_step > 0) ||
+       !(window->y_max > window->y_min)) return -18;
+
+   if (!(window->x_range / window->x_step <= MAX_WINDOW_POINTS)) return -19;
+
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_win_alloc(RTPS_Window *window)
+ *
+ *  @brief      Allocate the circular buffer of a validated window
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_win_alloc(RTPS_Window *window)
+{
+   size_t max_points = (size_t)floor(window->x_range / window->x_step);
+   return cb_init(&window->cb, window->y_count, max_points) ? 0 : -4;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_open_renderer(RTPS_Window *window)
+ *
+ *  @brief      Create the SDL window and renderer of a window whose buffer is allocated
+ *
+ *  Must be called from the thread that initialized SDL.
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_open_renderer(RTPS_Window *window)
+{
+   if (headless)
+   {
+      // Software renderer drawing into a surface; no display needed
+      window->surface = SDL_CreateRGBSurfaceWithFormat(0, window->width, window->height,
+                                                       32, SDL_PIXELFORMAT_ARGB8888);
+      if (window->surface == NULL) return -3;
+      window->sdlrendr = SDL_CreateSoftwareRenderer(window->surface);
+      if (window->sdlrendr == NULL) return -3;
+   }
+   else
+   {
+      // Create & attach to SDL window/renderer
+      window->sdlwin = SDL_CreateWindow(window->title,
+                                        SDL_WINDOWPOS_CENTERED, // x pos
+                                        SDL_WINDOWPOS_CENTERED, // y pos
+                                        window->width,
+                                        window->height,
+                                        SDL_WINDOW_SHOWN);
+
+      Uint32 flags = SDL_RENDERER_ACCELERATED | (frame_vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+      window->sdlrendr = SDL_CreateRenderer(window->sdlwin, -1, flags);
+      if (window->sdlwin == NULL || window->sdlrendr == NULL) return -3;
+   }
+
+   // Series colors may be translucent
+   SDL_SetRenderDrawBlendMode(window->sdlrendr, SDL_BLENDMODE_BLEND);
+
+   window->dirty = true;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_open(RTPS_Window *window)
+ *
+ *  @brief      Allocate the buffer and SDL resources of a configured window
+ *
+ *  Must be called from the thread that initialized SDL.
+ *
+ *  @param      window  Pointer to RTPS_Window holding a parsed configuration
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_open(RTPS_Window *window)
+{
+   int rc;
+
+   if (window == NULL) return -1;
+   if ((rc = RTPS_win_check(window)) < 0) return rc;
+   if ((rc = RTPS_win_alloc(window)) < 0) return rc;
+
+   return RTPS_server_open_renderer(window);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_server_close(RTPS_Window *window)
+ *
+ *  @brief      Release the buffer and SDL resources opened by RTPS_server_open()
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_server_close(RTPS_Window *window)
+{
+   if (window->sdlrendr != NULL) SDL_DestroyRenderer(window->sdlrendr);
+   if (window->sdlwin != NULL) SDL_DestroyWindow(window->sdlwin);
+   if (window->surface != NULL) SDL_FreeSurface(window->surface);
+   cb_free(&window->cb);
+   if (window->chrome != NULL) SDL_DestroyTexture(window->chrome);
+   if (window->xgrid != NULL) SDL_DestroyTexture(window->xgrid);
+   for (int k = 0; k < 2; k++)
+   {
+      if (window->trace[k] != NULL) SDL_DestroyTexture(window->trace[k]);
+      window->trace[k] = NULL;
+   }
+   free(window->plot_pts);
+   free(window->plot_verts);
+   free(window->latency);
+   free(window->stamps);
+   if (window->shm != NULL) munmap(window->shm, window->shm_len);
+
+   window->sdlrendr = NULL;
+   window->shm = NULL;
+   window->sdlwin = NULL;
+   window->surface = NULL;
+   window->plot_pts = NULL;
+   window->plot_verts = NULL;
+   window->chrome = NULL;
+   window->xgrid = NULL;
+   window->latency = NULL;
+   window->stamps = NULL;
+   window->stamp_count = window->stamp_cap = 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_create(cJSON *root, RTPS_Window *window)
+ *
+ *  @brief      Create a new plot window from JSON
+ *
+ *  @param      root    cJSON root
+ *  @param      window  Pointer to instantiated RTPS_Window
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_create(cJSON *root, RTPS_Window *window)
+{
+   if (root == NULL) return -1;
+
+   if (0 == RTPS_cjson_to_win(root, window))
+      return RTPS_server_open(window);
+
+   return -2;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_init()
+ *  
+ *  @brief	Initialize RTPS server
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_init()
+{
+   // Events alone still turn SIGINT and SIGTERM into SDL_QUIT
+   SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_set_headless(const char *dir, int dump_fps)
+ *  
+ *  @brief	Render windows into memory instead of onto a display
+ *
+ *  @param	dir		Directory for PPM frame dumps; NULL for none
+ *  @param	dump_fps	Dumps per second for each window; 0 for every frame
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_headless(const char *dir, int dump_fps)
+{
+   headless = true;
+   dump_dir = dir;
+   dump_interval_ns = (dump_fps > 0) ? 1000000000ull / dump_fps : 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_set_frame_rate(int fps)
+ *  
+ *  @brief	Set the rate at which dirty windows are redrawn
+ *
+ *  @param	fps	Frames per second; 0 to present in step with the display (vsync)
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_frame_rate(int fps)
+{
+   frame_vsync = (fps <= 0);
+   frame_interval_ns = frame_vsync ? 0 : 1000000000ull / fps;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_set_latency_overlay(bool on)
+ *  
+ *  @brief	Show each window's send-to-present latency over its plot
+ *
+ *  @param	on	true to show the readout
+ *
+ *---------------------------------------------------------------------------------------
+ */
+void RTPS_server_set_latency_overlay(bool on)
+{
+   latency_overlay = on;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_dump(RTPS_Window *window)
+ *  
+ *  @brief	Write a headless window's surface to dump_dir as a binary PPM
+ *
+ *  Files are named rtps-<window>-<frame>.ppm.
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_dump(RTPS_Window *window)
+{
+   char path[PATH_MAX];
+   SDL_Surface *s = window->surface;
+   int rc = 0;
+
+   snprintf(path, sizeof(path), "%s/rtps-%03d-%06llu.ppm", dump_dir, window->id,
+            (unsigned long long)window->frame_count);
+   FILE *fp = fopen(path, "wb");
+   uint8_t *row = malloc((size_t)s->w * 3);
+   if (fp == NULL || row == NULL)
+   {
+      rc = -1;
+      goto _err_ret;
+   }
+
+   fprintf(fp, "P6\n%d %d\n255\n", s->w, s->h);
+   SDL_LockSurface(s);
+   for (int y = 0; y < s->h && rc == 0; y++)
+   {
+      const uint32_t *px = (const uint32_t *)((const uint8_t *)s->pixels + (size_t)y * s->pitch);
+      for (int x = 0; x < s->w; x++)
+      {
+         row[3*x+0] = (uint8_t)(px[x] >> 16);
+         row[3*x+1] = (uint8_t)(px[x] >> 8);
+         row[3*x+2] = (uint8_t)px[x];
+      }
+      if (fwrite(row, 3, s->w, fp) != (size_t)s->w) rc = -2;
+   }
+   SDL_UnlockSurface(s);
+
+_err_ret:
+   if (rc < 0) RTPS_perror("Frame dump failed.");
+   if (fp != NULL && fclose(fp) != 0 && rc == 0) rc = -2;
+   free(row);
+   return rc;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_shutdown(RTPS_Server *srv)
+ *  
+ *  @brief	RTPS server shutdown; closes every window
+ *
+ *  @param	srv	RTPS_Server pointer 
+ *
+ *  @return	0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_shutdown(RTPS_Server *srv)
+{
+   if (srv == NULL) return -1;
+
+   for (int i = 0; i < MAX_WINDOWS; i++)
+   {
+      free(srv->orphan[i]);
+      srv->orphan[i] = NULL;
+      if (srv->win[i] == NULL) continue;
+      RTPS_server_close(srv->win[i]);
+      free(srv->win[i]);
+      srv->win[i] = NULL;
+   }
+   SDL_Quit();
+
+   return 0;
+}
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		bool RTPS_server_forced_exit()
+ *
+ *  @return	true if forced exit
+ *
+ *---------------------------------------------------------------------------------------
+ */
+bool RTPS_server_forced_exit()
+{
+   SDL_Event e;
+   while (SDL_PollEvent(&e))
+      if (e.type == SDL_QUIT)
+         return true;
+
+   return false;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_wait_for_connection(RTPS_Connection *conn, int port)
+ *
+ *  @brief      Open the Real-Time Plot Server listening socket
+ *
+ *  Returns without waiting; clients are accepted by the ingest thread.
+ *
+ *  @param      conn    Pointer to instantiated RTPS_Connection
+ *  @param      port    TCP port number
+ *
+ *  @return     0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_wait_for_connection(RTPS_Connection *conn, int port)
+{
+   int on = 1;
+
+   conn->connected = false;
+   conn->client = -1;
+   conn->udp_fd = -1;
+   conn->type = SOCK_STREAM;
+   conn->max_msg = RTPS_FRAME_HDR_LEN + RTPS_MAX_FRAME_LEN;
+   conn->listening = false;
+   conn->unix_address.sun_family = 0;
+   conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   if (conn->fd < 0)
+   {
+     RTPS_perror("Socket failed.");
+     goto _err_ret;
+   }
+   setsockopt(conn->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+   conn->port = port;
+   conn->address.sin_family = AF_INET;
+   conn->address.sin_addr.s_addr = INADDR_ANY;
+   conn->address.sin_port = htons(conn->port);
+
+   if (bind(conn->fd, (struct sockaddr*)&conn->address, sizeof(conn->address)) < 0)
+   {
+      RTPS_perror("Bind failed");
+      goto _err_ret;
+   }
+
+   if (listen(conn->fd, SOMAXCONN) < 0)
+   {
+      RTPS_perror("Listen failed");
+      goto _err_ret;
+   }
+   conn->connected = true;
+   return 0;
+
+_err_ret:
+   RTPS_disconnect(conn);
+   return -1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         bool RTPS_unix_stale(const struct sockaddr_un *addr, int type)
+ *
+ *  @brief      Check for a socket file left by a server that did not exit cleanly
+ *
+ *  @return     true if addr names a socket file nobody is listening on
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+bool RTPS_unix_stale(const struct sockaddr_un *addr, int type)
+{
+   struct stat st;
+   bool stale = false;
+
+   if (lstat(addr->sun_path, &st) < 0 || !S_ISSOCK(st.st_mode))
+      return false;
+
+   int fd = socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+   if (fd < 0) return false;
+   if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 && errno == ECONNREFUSED)
+      stale = true;
+   close(fd);
+   return stale;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_wait_for_endpoint(RTPS_Connection *conn, const char *endpoint)
+ *
+ *  @brief      Open the listening socket given as a port number, "unix:/path" or
+ *              "unixpacket:/path"
+ *
+ *  @param      conn            Pointer to instantiated RTPS_Connection
+ *  @param      endpoint        Where to listen
+ *
+ *  @return     0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_wait_for_endpoint(RTPS_Connection *conn, const char *endpoint)
+{
+   struct sockaddr_un addr;
+   int type;
+
+   if (conn == NULL || endpoint == NULL) return -1;
+
+   int local = RTPS_unix_endpoint(endpoint, &addr, &type);
+   if (local == 0 && RTPS_is_all_digits(endpoint))
+      return RTPS_wait_for_connection(conn, atoi(endpoint));
+
+   memset(conn, 0, sizeof(*conn));
+   conn->fd = -1;
+   conn->client = -1;
+   conn->udp_fd = -1;
+   if (local <= 0)
+   {
+      RTPS_perror("Bad endpoint");
+      return -1;
+   }
+
+   conn->type = type;
+   conn->max_msg = (type == SOCK_SEQPACKET) ? UNIX_PACKET_LEN : RTPS_FRAME_HDR_LEN + RTPS_MAX_FRAME_LEN;
+   conn->unix_address = addr;
+   conn->fd = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (conn->fd < 0)
+   {
+     RTPS_perror("Socket failed.");
+     return -1;
+   }
+
+   // Replace the path only if it is a dead server's socket
+   int rc = bind(conn->fd, (struct sockaddr *)&addr, sizeof(addr));
+   if (rc < 0 && errno == EADDRINUSE && RTPS_unix_stale(&addr, type))
+   {
+      unlink(addr.sun_path);
+      rc = bind(conn->fd, (struct sockaddr *)&addr, sizeof(addr));
+   }
+   if (rc < 0)
+   {
+      RTPS_perror("Bind failed");
+      goto _err_ret;
+   }
+   conn->listening = true;
+
+   if (listen(conn->fd, SOMAXCONN) < 0)
+   {
+      RTPS_perror("Listen failed");
+      goto _err_ret;
+   }
+   conn->connected = true;
+   return 0;
+
+_err_ret:
+   RTPS_disconnect(conn);
+   return -1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         SDL_Texture *RTPS_layer_create(RTPS_Window *window, int w, int h)
+ *
+ *  @brief      Create a transparent texture and make it the render target
+ *
+ *  @return     Texture if successful; NULL otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+SDL_Texture *RTPS_layer_create(RTPS_Window *window, int w, int h)
+{
+   SDL_Texture *tex = SDL_CreateTexture(window->sdlrendr, SDL_PIXELFORMAT_ARGB8888,
+                                        SDL_TEXTUREACCESS_TARGET, w, h);
+   if (tex == NULL) return NULL;
+
+   if (SDL_SetRenderTarget(window->sdlrendr, tex) < 0)
+   {
+      SDL_DestroyTexture(tex);
+      return NULL;
+   }
+   SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+   SDL_SetRenderDrawColor(window->sdlrendr, 0, 0, 0, 0);
+   SDL_RenderClear(window->sdlrendr);
+   return tex;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_cache_layers(RTPS_Window *window, double x_start)
+ *
+ *  @brief      Make sure the static and x grid layers are rendered
+ *
+ *  The static layer is drawn once per window. The x grid layer only translates as
+ *  the plot scrolls and is redrawn when its first grid line changes.
+ *
+ *  @param      window  RTPS_Window pointer
+ *  @param      x_start First x grid line in view
+ *
+ *  @return     0 if both layers are ready; negative if they must be drawn directly
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_cache_layers(RTPS_Window *window, double x_start)
+{
+   int plot_width  = window->width - PLOT_MARGIN_RIGHT - PLOT_MARGIN_LEFT;
+   int plot_height = window->height - PLOT_MARGIN_BOTTOM - PLOT_MARGIN_TOP;
+
+   if (window->no_cache) return -1;
+
+   if (window->chrome == NULL)
+   {
+      if ((window->chrome = RTPS_layer_create(window, window->width, window->height)) == NULL)
+         goto _err_ret;
+      draw_static(window);
+   }
+
+   if (window->xgrid == NULL || window->xgrid_start != x_start)
+   {
+      // Lines plus the labels hanging off either end, down to the label baseline
+      if (window->xgrid == NULL)
+      {
+         window->xgrid = RTPS_layer_create(window, plot_width + PLOT_MARGIN_RIGHT + 4*PLOT_LABEL_PAD,
+                                           plot_height + PLOT_MARGIN_BOTTOM);
+         if (window->xgrid == NULL) goto _err_ret;
+      }
+      else
+      {
+         SDL_SetRenderTarget(window->sdlrendr, window->xgrid);
+         SDL_SetRenderDrawColor(window->sdlrendr, 0, 0, 0, 0);
+         SDL_RenderClear(window->sdlrendr);
+      }
+      draw_grid_x(window, x_start, PLOT_LABEL_PAD, 0);
+      window->xgrid_start = x_start;
+   }
+
+   SDL_SetRenderTarget(window->sdlrendr, NULL);
+   return 0;
+
+_err_ret:
+   SDL_SetRenderTarget(window->sdlrendr, NULL);
+   window->no_cache = true;
+   return -1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_trace_update(RTPS_Window *window, const RTPS_PlotMap *map,
+ *                                    double x_offset)
+ *
+ *  @brief      Bring the plot area texture up to date with the newest points
+ *
+ *  The texture keeps what was drawn in earlier frames. When the plot scrolls, it is
+ *  copied into the spare texture shifted left by the number of columns x_offset moved,
+ *  and only the segments after the last drawn point are rasterized. The whole trace is
+ *  repainted when there is no usable history: first frame, x going backwards, or a
+ *  jump of a full plot width.
+ *
+ *  @param      window  RTPS_Window pointer
+ *  @param      map     Mapping with the window's x_scale and origin
+ *  @param      x_offset  x at the left edge
+ *
+ *  @return     0 if the trace is ready; negative if the plot must be drawn directly
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_trace_update(RTPS_Window *window, const RTPS_PlotMap *map, double x_offset)
+{
+   DataPoint newest;
+   RTPS_PlotMap local = { map->x_scale, map->origin, map->y_scale, 0, 0 };
+   CircularBuffer *cb = &window->cb;
+
+   int w = window->width - PLOT_MARGIN_RIGHT - PLOT_MARGIN_LEFT + 1;
+   int h = window->height - PLOT_MARGIN_BOTTOM - PLOT_MARGIN_TOP + 1;
+
+   if (window->no_cache) return -1;
+
+   if (window->trace[0] == NULL)
+   {
+      for (int k = 0; k < 2; k++)
+      {
+         if ((window->trace[k] = RTPS_layer_create(window, w, h)) == NULL)
+         {
+            SDL_SetRenderTarget(window->sdlrendr, NULL);
+            window->no_cache = true;
+            return -1;
+         }
+      }
+      window->trace_valid = false;
+   }
+
+   double shift = map->origin - window->trace_origin;
+   bool full = !window->trace_valid || shift < 0 || shift >= w ||
+               window->trace_last_x < x_offset;
+
+   size_t first;
+   if (full)
+   {
+      // Start at the last point left of the first column so the entering segment is drawn
+      first = cb_lower_bound(cb, map->origin / map->x_scale);
+      if (first > 0) first--;
+
+      SDL_SetRenderTarget(window->sdlrendr, window->trace[window->trace_cur]);
+      SDL_SetRenderDrawColor(window->sdlrendr, 0, 0, 0, 0);
+      SDL_RenderClear(window->sdlrendr);
+   }
+   else
+   {
+      // Continue from the newest point already drawn
+      first = cb_lower_bound(cb, window->trace_last_x);
+
+      if (shift > 0)
+      {
+         SDL_Texture *src = window->trace[window->trace_cur];
+         window->trace_cur ^= 1;
+
+         SDL_Rect dst = { -(int)shift, 0, w, h };
+         SDL_SetRenderTarget(window->sdlrendr, window->trace[window->trace_cur]);
+         SDL_SetRenderDrawColor(window->sdlrendr, 0, 0, 0, 0);
+         SDL_RenderClear(window->sdlrendr);
+         SDL_SetTextureBlendMode(src, SDL_BLENDMODE_NONE);
+         SDL_RenderCopy(window->sdlrendr, src, NULL, &dst);
+         SDL_SetTextureBlendMode(src, SDL_BLENDMODE_BLEND);
+      }
+      else
+      {
+         SDL_SetRenderTarget(window->sdlrendr, window->trace[window->trace_cur]);
+      }
+   }
+
+   draw_plot(window, &local, x_offset, first);
+   SDL_SetRenderTarget(window->sdlrendr, NULL);
+
+   window->trace_origin = map->origin;
+   window->trace_last_x = (cb_peek_head(cb, -1, &newest) >= 0) ? newest.x : x_offset;
+   window->trace_valid = true;
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_latency_add(RTPS_Latency *lat, int stage, uint64_t now,
+ *                                    uint64_t sent, uint32_t count)
+ *
+ *  @brief      Record that count points sent at sent reached a stage at now
+ *
+ *  A clock step can put now before sent; that counts as no delay.
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static inline
+void RTPS_latency_add(RTPS_Latency *lat, int stage, uint64_t now, uint64_t sent, uint32_t count)
+{
+   lh_record(&lat->stage[stage], (now > sent) ? now - sent : 0, count);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_window_stamp(RTPS_Window *window, uint64_t sent, uint32_t count)
+ *
+ *  @brief      Hold a timestamped batch until the frame that shows it is presented
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_window_stamp(RTPS_Window *window, uint64_t sent, uint32_t count)
+{
+   if (window->latency == NULL) return -1;
+
+   if (window->stamp_count == window->stamp_cap)
+   {
+      size_t cap = window->stamp_cap ? 2 * window->stamp_cap : 64;
+      RTPS_Stamp *stamps = realloc(window->stamps, cap * sizeof(RTPS_Stamp));
+      if (stamps == NULL) return -2;
+      window->stamps = stamps;
+      window->stamp_cap = cap;
+   }
+   window->stamps[window->stamp_count++] = (RTPS_Stamp){ sent, count };
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void draw_latency(RTPS_Window *window, uint64_t now)
+ *
+ *  @brief      Draw the latency readout, refreshed once a second
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void draw_latency(RTPS_Window *window, uint64_t now)
+{
+   RTPS_Latency *lat = window->latency;
+   if (lat == NULL) return;
+
+   if (now >= lat->shown_ns + 1000000000ull)
+   {
+      const LatencyHist *h = &lat->stage[RTPS_STAGE_PRESENT];
+      if (lh_count(h, &lat->shown) > 0)
+         snprintf(lat->text, sizeof(lat->text), "latency p50 %.2f ms  p99 %.2f ms",
+                  lh_percentile(h, &lat->shown, 0.50) / 1e6,
+                  lh_percentile(h, &lat->shown, 0.99) / 1e6);
+      else
+         lat->text[0] = '\0';
+      lh_snapshot(h, &lat->shown);
+      lat->shown_ns = now;
+   }
+
+   int x = window->width - PLOT_MARGIN_RIGHT - 8 * (int)strlen(lat->text);
+   stringRGBA(window->sdlrendr, x, PLOT_MARGIN_TOP - 12, lat->text, 80, 80, 80, 255);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_redraw(RTPS_Window *window)
+ *
+ *  @brief      Redraw the window, ending at its newest point
+ *
+ *  @return     0 if success; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_redraw(RTPS_Window *window)
+{
+   DataPoint newest = {0};
+
+   if (window == NULL) return -1;
+
+   // Before the first point arrives the plot starts at x = 0
+   double x_offset = 0;
+   if (cb_peek_head(&window->cb, -1, &newest) >= 0)
+      x_offset = newest.x - window->x_range;
+
+   int plot_left   = PLOT_MARGIN_LEFT;
+   int plot_top    = PLOT_MARGIN_TOP;
+   int plot_width  = window->width - PLOT_MARGIN_RIGHT - plot_left;
+   int plot_height = window->height - PLOT_MARGIN_BOTTOM - plot_top;
+
+   // Everything scrolls in whole pixel columns counted from x = 0
+   RTPS_PlotMap map;
+   map.x_scale = plot_width / window->x_range;
+   map.origin  = floor(x_offset * map.x_scale);
+   map.y_scale = plot_height / (window->y_max - window->y_min);
+   map.left    = plot_left;
+   map.top     = plot_top;
+
+   double x_start = ceil(x_offset / window->x_grid_step) * window->x_grid_step;
+   int x_left = plot_left + (int)(floor(x_start * map.x_scale) - map.origin);
+
+   if (RTPS_cache_layers(window, x_start) == 0)
+   {
+      SDL_RenderCopy(window->sdlrendr, window->chrome, NULL, NULL);
+
+      // Grid lines stay inside the plot; labels may overhang its edges
+      int w, h;
+      SDL_QueryTexture(window->xgrid, NULL, NULL, &w, &h);
+      SDL_Rect dst = { x_left - PLOT_LABEL_PAD, plot_top, w, h };
+      SDL_Rect lines = { plot_left, plot_top, plot_width, plot_height + 1 };
+      SDL_Rect labels = { plot_left - PLOT_LABEL_PAD, plot_top + plot_height + 1,
+                          window->width - plot_left + PLOT_LABEL_PAD, h - plot_height - 1 };
+
+      SDL_RenderSetClipRect(window->sdlrendr, &lines);
+      SDL_RenderCopy(window->sdlrendr, window->xgrid, NULL, &dst);
+      SDL_RenderSetClipRect(window->sdlrendr, &labels);
+      SDL_RenderCopy(window->sdlrendr, window->xgrid, NULL, &dst);
+      SDL_RenderSetClipRect(window->sdlrendr, NULL);
+   }
+   else
+   {
+      draw_static(window);
+      draw_grid_x(window, x_start, x_left, plot_top);
+   }
+
+   if (RTPS_trace_update(window, &map, x_offset) == 0)
+   {
+      SDL_Rect area = { plot_left, plot_top, plot_width + 1, plot_height + 1 };
+      SDL_RenderCopy(window->sdlrendr, window->trace[window->trace_cur], NULL, &area);
+   }
+   else
+   {
+      size_t first = cb_lower_bound(&window->cb, map.origin / map.x_scale);
+      draw_plot(window, &map, x_offset, (first > 0) ? first - 1 : 0);
+   }
+
+   uint64_t now = RTPS_clock_ns();
+   if (latency_overlay) draw_latency(window, now);
+
+   SDL_RenderPresent(window->sdlrendr);
+
+   // Everything pushed before this frame is now on screen
+   if (window->stamp_count > 0)
+   {
+      now = RTPS_clock_ns();
+      for (size_t i = 0; i < window->stamp_count; i++)
+         RTPS_latency_add(window->latency, RTPS_STAGE_PRESENT, now,
+                          window->stamps[i].sent_ns, window->stamps[i].count);
+      window->stamp_count = 0;
+   }
+
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void *RTPS_event_reserve(RTPS_Server *srv, uint16_t type, uint16_t window,
+ *                                       uint32_t count, size_t len)
+ *
+ *  @brief      Reserve an event in the render queue, waiting while it is full
+ *
+ *  @param      srv     RTPS_Server pointer
+ *  @param      type    RTPS_EVENT_*
+ *  @param      window  Window handle the event applies to
+ *  @param      count   Number of items in the payload
+ *  @param      len     Payload length
+ *
+ *  @return     Pointer to the event payload; NULL if the server is stopping
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void *RTPS_event_reserve(RTPS_Server *srv, uint16_t type, uint16_t window, uint32_t count, size_t len)
+{
+   RTPS_Event *ev;
+
+   while ((ev = spsc_reserve(srv->queue, sizeof(RTPS_Event) + len)) == NULL)
+   {
+      if (!atomic_load(&srv->running)) return NULL;
+
+      // Back-pressure: the render thread is behind, let TCP queue up instead
+      atomic_fetch_add(&srv->queue_stalls, 1);
+      usleep(100);
+   }
+   ev->type = type;
+   ev->window = window;
+   ev->count = count;
+   ev->sent_ns = (type == RTPS_EVENT_PLOT) ? srv->rx_sent_ns : 0;
+   return ev + 1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_event_commit(RTPS_Server *srv, void *payload, uint32_t count,
+ *                                     size_t len)
+ *
+ *  @brief      Publish the reserved event to the render thread
+ *
+ *  Timestamped plot data is counted in its window's receive, parse and queue
+ *  latency on the way.
+ *
+ *  @param      srv     RTPS_Server pointer
+ *  @param      payload Payload returned by RTPS_event_reserve()
+ *  @param      count   Final number of items in the payload
+ *  @param      len     Final payload length
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_event_commit(RTPS_Server *srv, void *payload, uint32_t count, size_t len)
+{
+   RTPS_Event *ev = (RTPS_Event *)payload - 1;
+   ev->count = count;
+
+   // The event belongs to the render thread once committed
+   uint64_t sent = ev->sent_ns;
+   RTPS_Latency *lat = NULL;
+   if (sent != 0 && ev->window < MAX_WINDOWS)
+      lat = srv->slot[ev->window].latency;
+   if (lat == NULL || count == 0)
+   {
+      spsc_commit(srv->queue, sizeof(RTPS_Event) + len);
+      return;
+   }
+
+   uint64_t parsed = RTPS_clock_ns();
+   spsc_commit(srv->queue, sizeof(RTPS_Event) + len);
+   uint64_t queued = RTPS_clock_ns();
+
+   RTPS_latency_add(lat, RTPS_STAGE_RECV, srv->rx_ns, sent, count);
+   RTPS_latency_add(lat, RTPS_STAGE_PARSE, parsed, sent, count);
+   RTPS_latency_add(lat, RTPS_STAGE_QUEUE, queued, sent, count);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_json_ws(RTPS_JsonCursor *c)
+ *
+ *  @brief      Skip JSON whitespace
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static inline
+void RTPS_json_ws(RTPS_JsonCursor *c)
+{
+   while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+      c->p++;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         bool RTPS_json_eat(RTPS_JsonCursor *c, char ch)
+ *
+ *  @brief      Consume ch if it is the next non-whitespace character
+ *
+ *  @return     true if ch was consumed
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static inline
+bool RTPS_json_eat(RTPS_JsonCursor *c, char ch)
+{
+   RTPS_json_ws(c);
+   if (c->p < c->end && *c->p == ch)
+   {
+      c->p++;
+      return true;
+   }
+   return false;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_json_string(RTPS_JsonCursor *c, const char **s, size_t *len)
+ *
+ *  @brief      Consume a string and return its raw contents; escapes are not decoded
+ *
+ *  @param      c       Cursor
+ *  @param      s       Start of the contents, or NULL
+ *  @param      len     Length of the contents, or NULL
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_json_string(RTPS_JsonCursor *c, const char **s, size_t *len)
+{
+   if (!RTPS_json_eat(c, '"')) return -1;
+
+   const char *start = c->p;
+   for (; c->p < c->end && *c->p != '"'; c->p++)
+   {
+      if (*c->p == '\\') c->p++;
+   }
+   if (c->p >= c->end) return -1;
+
+   if (s != NULL) *s = start;
+   if (len != NULL) *len = (size_t)(c->p - start);
+   c->p++;
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_json_skip(RTPS_JsonCursor *c)
+ *
+ *  @brief      Consume one value of any type without decoding it
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_json_skip(RTPS_JsonCursor *c)
+{
+   int depth = 0;
+
+   RTPS_json_ws(c);
+   for (;;)
+   {
+      if (c->p >= c->end) return (depth == 0) ? 0 : -1;
+
+      char ch = *c->p;
+      if (ch == '"')
+      {
+         if (RTPS_json_string(c, NULL, NULL) < 0) return -1;
+         if (depth == 0) return 0;
+         continue;
+      }
+
+      if (ch == '[' || ch == '{')
+      {
+         depth++;
+      }
+      else if (ch == ']' || ch == '}')
+      {
+         if (depth == 0) return 0;
+         if (--depth == 0)
+         {
+            c->p++;
+            return 0;
+         }
+      }
+      else if (ch == ',' && depth == 0)
+      {
+         return 0;
+      }
+      c->p++;
+   }
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_json_u64(RTPS_JsonCursor *c, uint64_t *v)
+ *
+ *  @brief      Consume a non-negative integer without going through double
+ *
+ *  @param      c       Cursor
+ *  @param      v       Value
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_json_u64(RTPS_JsonCursor *c, uint64_t *v)
+{
+   RTPS_json_ws(c);
+
+   const char *p = c->p;
+   uint64_t m = 0;
+
+   for (; p < c->end && (unsigned)(*p - '0') < 10; p++)
+   {
+      if (m > (UINT64_MAX - 9) / 10) return -1;
+      m = m * 10 + (uint64_t)(*p - '0');
+   }
+   if (p == c->p) return -1;
+
+   *v = m;
+   c->p = p;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_json_number(RTPS_JsonCursor *c, double *v)
+ *
+ *  @brief      Consume a number; null reads as 0, as it did through cJSON
+ *
+ *  Numbers with up to 19 significant digits and a small exponent are converted
+ *  exactly with one multiply or divide by a power of ten; anything else goes to
+ *  strtod.
+ *
+ *  @param      c       Cursor
+ *  @param      v       Value
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_json_number(RTPS_JsonCursor *c, double *v)
+{
+   static const double pow10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+   };
+
+   RTPS_json_ws(c);
+
+   const char *p = c->p;
+   const char *start = p;
+
+   if (c->end - p >= 4 && 0 == memcmp(p, "null", 4))
+   {
+      *v = 0;
+      c->p = p + 4;
+      return 0;
+   }
+
+   bool neg = false;
+   bool exact = true;
+   uint64_t m = 0;
+   int exp10 = 0;
+   int digits = 0;
+   int e = 0;                   // written exponent
+
+   if (p < c->end && *p == '-')
+   {
+      neg = true;
+      p++;
+   }
+
+   for (; p < c->end && (unsigned)(*p - '0') < 10; p++, digits++)
+   {
+      if (m < 1000000000000000000ull)
+         m = m * 10 + (uint64_t)(*p - '0');
+      else
+         exp10++, exact = false;
+   }
+
+   if (p < c->end && *p == '.')
+   {
+      for (p++; p < c->end && (unsigned)(*p - '0') < 10; p++, digits++)
+      {
+         if (m < 1000000000000000000ull)
+            m = m * 10 + (uint64_t)(*p - '0'), exp10--;
+         else if (*p != '0')
+            exact = false;
+      }
+   }
+
+   if (digits == 0) return -1;
+
+   if (p < c->end && (*p == 'e' || *p == 'E'))
+   {
+      bool eneg = false;
+
+      p++;
+      if (p < c->end && (*p == '-' || *p == '+'))
+         eneg = (*p++ == '-');
+      if (p >= c->end || (unsigned)(*p - '0') >= 10) return -1;
+
+      for (; p < c->end && (unsigned)(*p - '0') < 10; p++)
+      {
+         if (e < 10000) e = e * 10 + (*p - '0');
+      }
+      if (eneg) e = -e;
+      exp10 += e;
+   }
+
+   if (exact && m <= (1ull << 53) && exp10 >= -22 && exp10 <= 22)
+   {
+      double d = (double)m;
+      d = (exp10 < 0) ? d / pow10[-exp10] : d * pow10[exp10];
+      *v = neg ? -d : d;
+   }
+   else
+   {
+      // The message is not NUL terminated; strtod works on a copy of the
+      // significant digits. No double needs more than 767 of them to round
+      // correctly, so the rest are replaced by a 1 if any is nonzero.
+      char num[800];
+      size_t n = 0, keep = sizeof(num) - 16;
+      bool frac = false, dropped = false;
+      const char *q = start;
+
+      if (*q == '-') num[n++] = *q++;
+      size_t lead = n;
+      for (; q < p && *q != 'e' && *q != 'E'; q++)
+      {
+         if (*q == '.')
+            frac = true;
+         else if (n == lead && *q == '0')
+            e -= frac;
+         else if (n < keep)
+            num[n++] = *q, e -= frac;
+         else
+            e += !frac, dropped |= (*q != '0');
+      }
+      if (n == lead) num[n++] = '0';
+      if (dropped) num[n++] = '1', e--;
+      snprintf(num + n, sizeof(num) - n, "e%d", e);
+      *v = strtod(num, NULL);
+   }
+
+   c->p = p;
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         void RTPS_plot_commit(RTPS_Server *srv, double *col, uint32_t n,
+ *                                    uint32_t cap, int y_count)
+ *
+ *  @brief      Queue n points that were parsed into columns reserved for cap points
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_plot_commit(RTPS_Server *srv, double *col, uint32_t n, uint32_t cap, int y_count)
+{
+   // Close the gaps between the columns
+   for (int j = 1; j <= y_count && n < cap; j++)
+      memmove(col + (size_t)j*n, col + (size_t)j*cap, n * sizeof(double));
+
+   RTPS_event_commit(srv, col, n, RTPS_PLOT_EVENT_LEN(n, y_count));
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_plot_data(RTPS_JsonCursor *c, RTPS_Server *srv, int id)
+ *
+ *  @brief      Parse the value of a "data" key straight into queued plot events
+ *
+ *  Points are parsed into columns reserved for EVENT_MAX_POINTS and queued as
+ *  each chunk fills. Values beyond the window's series are ignored and missing
+ *  ones read as 0. Points parsed before a syntax error are still queued.
+ *
+ *  return       0 success
+ *              -3 malformed data
+ *              -4 server stopping
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_plot_data(RTPS_JsonCursor *c, RTPS_Server *srv, int id)
+{
+   int y_count = srv->slot[id].y_count;
+   double *col = NULL;
+   uint32_t n = 0;
+   int rc = -3;
+
+   if (!RTPS_json_eat(c, '[') || RTPS_json_eat(c, ']')) return -3;
+
+   // A single point is [x, y0, y1, ...]; a batch is an array of points
+   RTPS_json_ws(c);
+   bool single = (c->p < c->end && *c->p != '[');
+   uint32_t cap = single ? 1 : EVENT_MAX_POINTS;
+
+   for (;;)
+   {
+      if (col == NULL)
+      {
+         col = RTPS_event_reserve(srv, RTPS_EVENT_PLOT, id, 0, RTPS_PLOT_EVENT_LEN(cap, y_count));
+         if (col == NULL) return -4;
+         n = 0;
+      }
+
+      if (!single && !RTPS_json_eat(c, '[')) goto _err_ret;
+
+      int k = 0;
+      if (!RTPS_json_eat(c, ']'))
+      {
+         do
+         {
+            double v;
+            if (RTPS_json_number(c, &v) < 0) goto _err_ret;
+            if (k <= y_count) col[(size_t)k*cap + n] = v;
+            k++;
+         }
+         while (RTPS_json_eat(c, ','));
+
+         if (!RTPS_json_eat(c, ']')) goto _err_ret;
+      }
+      for (; k <= y_count; k++)
+         col[(size_t)k*cap + n] = 0;
+      n++;
+
+      if (single) break;
+
+      if (n == cap)
+      {
+         RTPS_event_commit(srv, col, n, RTPS_PLOT_EVENT_LEN(n, y_count));
+         col = NULL;
+      }
+
+      if (RTPS_json_eat(c, ']')) break;
+      if (!RTPS_json_eat(c, ',')) goto _err_ret;
+   }
+   rc = 0;
+
+_err_ret:
+   // A reservation left uncommitted is reused by the next event
+   if (col != NULL && n > 0)
+      RTPS_plot_commit(srv, col, n, cap, y_count);
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_plot(RTPS_Server *srv, const uint8_t *message, size_t len)
+ *
+ *  @brief      Parse a JSON "plot" message in one pass and queue its points
+ *
+ *  Keys may come in any order. When "data" comes before "cmd" and "window" it
+ *  is skipped and parsed once they are known; otherwise parsing stops at the
+ *  end of "data" and later keys, including "ts", are ignored. Anything that is
+ *  not a "plot" command is left to cJSON.
+ *
+ *  return       1 not a "plot" message
+ *               0 success
+ *              -1 unknown window
+ *              -2 cannot find 'data' key
+ *              -3 malformed data
+ *              -4 server stopping
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_plot(RTPS_Server *srv, const uint8_t *message, size_t len)
+{
+   RTPS_JsonCursor c = { (const char *)message, (const char *)message + len };
+   RTPS_JsonCursor data = { NULL, NULL };
+   bool plot = false;
+   bool have_window = false;
+   int id = 0;
+
+   if (!RTPS_json_eat(&c, '{') || RTPS_json_eat(&c, '}')) return 1;
+
+   do
+   {
+      const char *key;
+      size_t key_len;
+
+      if (RTPS_json_string(&c, &key, &key_len) < 0 || !RTPS_json_eat(&c, ':'))
+         return plot ? -2 : 1;
+
+      if (key_len == 3 && 0 == memcmp(key, "cmd", 3))
+      {
+         const char *cmd;
+         size_t cmd_len;
+
+         if (RTPS_json_string(&c, &cmd, &cmd_len) < 0) return 1;
+         if (cmd_len != 4 || 0 != memcmp(cmd, "plot", 4)) return 1;
+         plot = true;
+      }
+      else if (key_len == 6 && 0 == memcmp(key, "window", 6))
+      {
+         double w;
+
+         if (RTPS_json_number(&c, &w) < 0) return 1;
+         id = (w < 0 || w >= MAX_WINDOWS) ? -1 : (int)w;
+         have_window = true;
+      }
+      else if (key_len == 2 && 0 == memcmp(key, "ts", 2))
+      {
+         if (RTPS_json_u64(&c, &srv->rx_sent_ns) < 0) return plot ? -3 : 1;
+      }
+      else if (key_len == 4 && 0 == memcmp(key, "data", 4) && plot && have_window)
+      {
+         // Common case, data parsed in place
+         if (id < 0 || !srv->slot[id].open) goto _unknown;
+         return RTPS_plot_data(&c, srv, id);
+      }
+      else
+      {
+         if (key_len == 4 && 0 == memcmp(key, "data", 4))
+         {
+            RTPS_json_ws(&c);
+            data = c;
+         }
+         if (RTPS_json_skip(&c) < 0) return plot ? -3 : 1;
+      }
+   }
+   while (RTPS_json_eat(&c, ','));
+
+   if (!plot) return 1;
+   if (data.p == NULL) return -2;
+   if (id < 0 || !srv->slot[id].open) goto _unknown;
+
+   return RTPS_plot_data(&data, srv, id);
+
+_unknown:
+   RTPS_perror("Window not created.");
+   return -1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_plot_binary(const uint8_t *buf, size_t len, RTPS_Server *srv)
+ *
+ *  @brief      Decode all points of a binary "plot" message and queue them
+ *
+ *  return       0 success
+ *              -1 buf or srv is NULL
+ *              -2 malformed header or truncated payload
+ *              -3 unsupported message type
+ *              -4 unknown window, or series count does not match it
+ *              -5 server stopping
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_plot_binary(const uint8_t *buf, size_t len, RTPS_Server *srv)
+{
+   RTPS_BinHeader hdr;
+
+   if (buf == NULL || srv == NULL) return -1;
+
+   if (RTPS_bin_to_header(buf, len, &hdr) < 0) return -2;
+   if (hdr.type != RTPS_MSG_PLOT) return -3;
+   if (hdr.window >= MAX_WINDOWS || !srv->slot[hdr.window].open) return -4;
+   if (hdr.y_count != srv->slot[hdr.window].y_count) return -4;
+
+   if (hdr.flags & RTPS_BIN_FLAG_TS)
+      srv->rx_sent_ns = RTPS_get_le64(buf + RTPS_BIN_HDR_LEN);
+
+   const uint8_t *p = buf + RTPS_BIN_DATA_OFF(hdr.flags);
+   uint32_t remaining = hdr.count;
+   while (remaining > 0)
+   {
+      uint32_t n = (remaining < EVENT_MAX_POINTS) ? remaining : EVENT_MAX_POINTS;
+      double *col = RTPS_event_reserve(srv, RTPS_EVENT_PLOT, hdr.window, n,
+                                       RTPS_PLOT_EVENT_LEN(n, hdr.y_count));
+      if (col == NULL) return -5;
+
+      // Transpose the points into columns
+      for (uint32_t i = 0; i < n; i++)
+      {
+         col[i] = RTPS_get_f64(p);
+         for (int j = 0; j < hdr.y_count; j++)
+            col[(j+1)*n + i] = RTPS_get_f64(p + 8*(j+1));
+         p += RTPS_BIN_POINT_LEN(hdr.y_count);
+      }
+      RTPS_event_commit(srv, col, n, RTPS_PLOT_EVENT_LEN(n, hdr.y_count));
+      remaining -= n;
+   }
+
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_send(RTPS_Client *client, const void *buf, size_t len)
+ *
+ *  @brief      Send a reply to a client
+ *
+ *  A reply that is not sent whole leaves the stream out of step, so the client
+ *  is marked broken and dropped once the message being handled is done.
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_send(RTPS_Client *client, const void *buf, size_t len)
+{
+   if (client->broken) return -1;
+   if (RTPS_send_frame(client->fd, buf, len) < 0)
+   {
+      client->broken = true;
+      return -2;
+   }
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_reply(RTPS_Client *client, int status, int id, int encoding)
+ *
+ *  @brief      Acknowledge a "create" command
+ *
+ *  @param      client          Client that sent the command
+ *  @param      status          0 if the window was created; negative otherwise
+ *  @param      id              Handle of the new window
+ *  @param      encoding        Encoding the server agreed to for "plot" data
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_reply(RTPS_Client *client, int status, int id, int encoding)
+{
+   char message[MAX_JSON_LEN];
+
+   int len = snprintf(message, sizeof(message),
+                      "{\"cmd\":\"create\",\"status\":%d,\"window\":%d,\"encoding\":\"%s\"}",
+                      status, id, (encoding == RTPS_ENCODING_BINARY) ? "binary" : "json");
+
+   if (len < 0 || len >= (int)sizeof(message)) return -1;
+   return RTPS_server_send(client, message, len);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_reply_status(RTPS_Client *client, const char *cmd,
+ *                                           int status, int id)
+ *
+ *  @brief      Acknowledge a command other than "create"
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_reply_status(RTPS_Client *client, const char *cmd, int status, int id)
+{
+   char message[MAX_JSON_LEN];
+
+   int len = snprintf(message, sizeof(message), "{\"cmd\":\"%s\",\"status\":%d,\"window\":%d}",
+                      cmd, status, id);
+
+   if (len < 0 || len >= (int)sizeof(message)) return -1;
+   return RTPS_server_send(client, message, len);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_tx_printf(RTPS_TxBuffer *tx, const char *fmt, ...)
+ *
+ *  @brief      Append formatted text to an output buffer, growing it as needed
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_tx_printf(RTPS_TxBuffer *tx, const char *fmt, ...)
+{
+   va_list ap;
+
+   va_start(ap, fmt);
+   int len = vsnprintf((char *)tx->buf + tx->len, tx->cap - tx->len, fmt, ap);
+   va_end(ap);
+   if (len < 0) return -1;
+
+   if (tx->len + len >= tx->cap)
+   {
+      if (RTPS_tx_reserve(tx, len + 1) < 0) return -2;
+      va_start(ap, fmt);
+      vsnprintf((char *)tx->buf + tx->len, tx->cap - tx->len, fmt, ap);
+      va_end(ap);
+   }
+   tx->len += len;
+   return 0;
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         uint64_t RTPS_rss_bytes()
+ *
+ *  @brief      Resident memory of this process; 0 if unknown
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+uint64_t RTPS_rss_bytes()
+{
+   unsigned long long size, rss = 0;
+
+   FILE *fp = fopen("/proc/self/statm", "r");
+   if (fp == NULL) return 0;
+   if (fscanf(fp, "%llu %llu", &size, &rss) != 2) rss = 0;
+   fclose(fp);
+
+   return rss * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_reply_stats(RTPS_Server *srv, RTPS_Client *client)
+ *
+ *  @brief      Answer a "stats" command with the server's counters and gauges
+ *
+ *  Runs on the ingest thread. What the render thread owns is read from the
+ *  atomics it publishes, so figures from the two threads may be a frame apart.
+ *
+ *  @param      srv             RTPS_Server pointer
+ *  @param      client          Client that sent the command
+ *
+ *  @return     0 if successful; negative otherwise
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_reply_stats(RTPS_Server *srv, RTPS_Client *client)
+{
+   static const char *stage[RTPS_STAGES] = { "receive", "parse", "queue", "present" };
+   RTPS_TxBuffer tx = {0};
+   int windows = 0;
+   int rc = -1;
+
+   if (RTPS_tx_reserve(&tx, MAX_JSON_LEN) < 0) return -1;
+
+   for (int id = 0; id < MAX_WINDOWS; id++)
+      windows += srv->slot[id].open;
+
+   rc = RTPS_tx_printf(&tx,
+      "{\"cmd\":\"stats\",\"status\":0,"
+      "\"counters\":{\"messages\":%lu,\"bytes\":%lu,\"errors\":%lu,\"queue_stalls\":%lu,"
+      "\"udp_lost\":%lu,\"udp_dropped\":%lu,\"overwrites\":%lu,\"open_errors\":%lu,\"frames\":%lu,"
+      "\"frame_ns_last\":%lu,\"frame_ns_total\":%lu,\"frame_ns_max\":%lu},"
+      "\"gauges\":{\"clients\":%d,\"windows\":%d,\"queue_used\":%zu,\"queue_size\":%zu,"
+      "\"rss_bytes\":%llu},\"windows\":[",
+      atomic_load(&srv->rx_messages), atomic_load(&srv->rx_bytes), atomic_load(&srv->rx_errors),
+      atomic_load(&srv->queue_stalls), atomic_load(&srv->udp_lost), atomic_load(&srv->udp_dropped),
+      atomic_load(&srv->overwrites), atomic_load(&srv->open_errors), atomic_load(&srv->frames.count),
+      atomic_load(&srv->frames.last_ns), atomic_load(&srv->frames.total_ns),
+      atomic_load(&srv->frames.max_ns),
+      srv->client_count, windows, spsc_used(srv->queue), srv->queue->sz,
+      (unsigned long long)RTPS_rss_bytes());
+
+   bool first = true;
+   for (int id = 0; id < MAX_WINDOWS && rc == 0; id++)
+   {
+      RTPS_WindowSlot *slot = &srv->slot[id];
+      RTPS_WindowGauge *g = &srv->gauge[id];
+      if (!slot->open) continue;
+
+      rc = RTPS_tx_printf(&tx, "%s{\"window\":%d,\"fill\":%lu,\"capacity\":%lu,\"overwrites\":%lu",
+                          first ? "" : ",", id, atomic_load(&g->fill), atomic_load(&g->capacity),
+                          atomic_load(&g->overwrites));
+      first = false;
+
+      // Only windows that received timestamped data
+      if (rc == 0 && slot->latency != NULL && lh_count(&slot->latency->stage[RTPS_STAGE_RECV], NULL) > 0)
+      {
+         for (int s = 0; s < RTPS_STAGES && rc == 0; s++)
+         {
+            const LatencyHist *h = &slot->latency->stage[s];
+            rc = RTPS_tx_printf(&tx, "%s\"%s\":{\"count\":%lu,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+                                "\"p999_ns\":%llu,\"max_ns\":%lu}",
+                                (s == 0) ? ",\"latency\":{" : ",", stage[s], lh_count(h, NULL),
+                                (unsigned long long)lh_percentile(h, NULL, 0.50),
+                                (unsigned long long)lh_percentile(h, NULL, 0.99),
+                                (unsigned long long)lh_percentile(h, NULL, 0.999),
+                                atomic_load(&h->max));
+         }
+         if (rc == 0) rc = RTPS_tx_printf(&tx, "}");
+      }
+      if (rc == 0) rc = RTPS_tx_printf(&tx, "}");
+   }
+   if (rc == 0) rc = RTPS_tx_printf(&tx, "]}");
+
+   if (rc == 0) rc = RTPS_server_send(client, tx.buf, tx.len);
+   free(tx.buf);
+   return rc;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_peer_uid(int fd, uid_t *uid)
+ *
+ *  @brief      Find the user on the other end of a client connection
+ *
+ *  Unix sockets report the peer's credentials. A loopback TCP peer cannot be
+ *  identified, so it is taken to be this server's own user.
+ *
+ *  return       0 success
+ *              -1 peer is not on this host
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_peer_uid(int fd, uid_t *uid)
+{
+   struct sockaddr_storage addr;
+   socklen_t addrlen = sizeof(addr);
+
+   if (getpeername(fd, (struct sockaddr *)&addr, &addrlen) < 0)
+      return -1;
+
+   if (addr.ss_family == AF_UNIX)
+   {
+      struct ucred cred;
+      socklen_t credlen = sizeof(cred);
+      if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) < 0)
+         return -1;
+      *uid = cred.uid;
+      return 0;
+   }
+
+   if (addr.ss_family == AF_INET &&
+       (ntohl(((struct sockaddr_in *)&addr)->sin_addr.s_addr) >> 24) == 127)
+   {
+      *uid = geteuid();
+      return 0;
+   }
+   return -1;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn         int RTPS_server_attach(RTPS_Server *srv, RTPS_Client *client,
+ *                                     cJSON *root, int id)
+ *
+ *  @brief      Map a client's shared-memory ring and hand it to the render thread
+ *
+ *  The client must be on this host and own the ring.
+ *
+ *  return       0 success
+ *              -1 missing or foreign 'shm' name
+ *              -2 cannot open or map it
+ *              -3 not a ring
+ *              -4 server stopping
+ *              -5 client not local, or not the ring's owner
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_attach(RTPS_Server *srv, RTPS_Client *client, cJSON *root, int id)
+{
+   cJSON *name;
+   struct stat st;
+   void *mem = MAP_FAILED;
+   SpscReader rd;
+   uid_t uid;
+
+   // Only rings made by RTPS_client_attach_shm()
+   if ((name = cJSON_extract(root, 's', "shm")) == NULL ||
+       0 != strncmp(name->valuestring, "/rtps-", 6))
+   {
+      return -1;
+   }
+
+   if (RTPS_server_peer_uid(client->fd, &uid) < 0)
+      return -5;
+
+   int fd = shm_open(name->valuestring, O_RDWR, 0);
+   if (fd < 0) return -2;
+
+   if (fstat(fd, &st) < 0 || st.st_uid != uid)
+   {
+      close(fd);
+      return -5;
+   }
+   if (st.st_size > 0)
+      mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mem == MAP_FAILED) return -2;
+
+   // The ring size is fixed from here on, whatever the client writes later
+   if (!spsc_reader_init(&rd, mem, st.st_size))
+   {
+      munmap(mem, st.st_size);
+      return -3;
+   }
+
+   RTPS_ShmMap *map = RTPS_event_reserve(srv, RTPS_EVENT_ATTACH, id, 1, sizeof(RTPS_ShmMap));
+   if (map == NULL)
+   {
+      munmap(mem, st.st_size);
+      return -4;
+   }
+   map->ring = mem;
+   map->len = st.st_size;
+   map->rd = rd;
+   RTPS_event_commit(srv, map, 1, sizeof(RTPS_ShmMap));
+
+   return 0;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_dispatch(RTPS_Server *srv, RTPS_Client *client,
+ *                                       uint8_t *message, size_t len)
+ *
+ *  @brief	Process one complete message on the ingest thread
+ *
+ *  @param	srv	RTPS_Server pointer 
+ *  @param	client	Client that sent the message
+ *  @param	message	Message payload, JSON or binary
+ *  @param	len	Payload length
+ *
+ *  @return	0 if successful; negative otherwise
+ *  
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_dispatch(RTPS_Server *srv, RTPS_Client *client, uint8_t *message, size_t len)
+{
+   int rc = -1;	
+   int id = 0;
+   cJSON *root, *cmd, *enc, *win;
+
+   // Set by the plot parsers when the message carries a send timestamp
+   srv->rx_sent_ns = 0;
+
+   // Binary "plot" message; the window is checked against the header
+   if (len >= 2 && RTPS_get_le16(message) == RTPS_BIN_MAGIC)
+   {
+      if ((rc = RTPS_plot_binary(message, len, srv)) == -4)
+         RTPS_perror("Window not created.");
+      return rc;
+   }
+
+   // JSON "plot" message, parsed without building a tree
+   if ((rc = RTPS_plot(srv, message, len)) != 1) return rc;
+   rc = -1;
+
+   // Parse JSON string 
+   if ((root = cJSON_ParseWithLength((const char *)message, len)) == NULL) return -2;
+
+   // Check for command
+   if ((cmd = cJSON_extract(root, 's', "cmd")) == NULL) goto _err_ret;
+
+   // Commands other than "create" and "stats" address a window; 0 if not given
+   if ((win = cJSON_extract(root, 'n', "window")) != NULL)
+      id = win->valueint;
+   
+   // Parse and process different command type 
+   if (0 == strcmp(cmd->valuestring, "create"))
+   {
+      int encoding = RTPS_ENCODING_JSON;
+      if ((enc = cJSON_extract(root, 's', "encoding")) != NULL &&
+          0 == strcmp(enc->valuestring, "binary"))
+      {
+         encoding = RTPS_ENCODING_BINARY;
+      }
+
+      // Lowest free handle
+      for (id = 0; id < MAX_WINDOWS && srv->slot[id].open; id++);
+      if (id == MAX_WINDOWS)
+      {
+         RTPS_perror("Too many windows.");
+         RTPS_server_reply(client, -1, -1, encoding);
+         goto _err_ret;
+      }
+
+      // The window itself is opened on the render thread
+      RTPS_Window *cfg = RTPS_event_reserve(srv, RTPS_EVENT_CREATE, id, 1, sizeof(RTPS_Window));
+      if (cfg == NULL) goto _err_ret;
+      memset(cfg, 0, sizeof(RTPS_Window));
+
+      // Filled by this thread, read and freed by the render thread
+      if ((cfg->latency = calloc(1, sizeof(RTPS_Latency))) == NULL)
+         rc = -2;
+      else if ((rc = RTPS_cjson_to_win(root, cfg)) == 0 && (rc = RTPS_win_check(cfg)) == 0)
+      {
+         // Allocated here so the reply reports whether it worked
+         rc = RTPS_win_alloc(cfg);
+      }
+
+      if (rc == 0)
+      {
+         cfg->id = id;
+         cfg->gen = ++srv->slot[id].gen;
+         RTPS_event_commit(srv, cfg, 1, sizeof(RTPS_Window));
+         srv->slot[id].open = true;
+         srv->slot[id].y_count = cfg->y_count;
+         srv->slot[id].udp_synced = false;
+         srv->slot[id].latency = cfg->latency;
+         RTPS_server_reply(client, 0, id, encoding);
+      }
+      else
+      {
+         // Leave the reservation uncommitted; the next event reuses it
+         free(cfg->latency);
+         cb_free(&cfg->cb);
+         RTPS_perror("Window create.");
+         RTPS_server_reply(client, rc, -1, encoding);
+      }
+   }
+   else if (0 == strcmp(cmd->valuestring, "stats"))
+   {
+      if ((rc = RTPS_server_reply_stats(srv, client)) < 0)
+         RTPS_perror("Stats reply.");
+   }
+   else if (id < 0 || id >= MAX_WINDOWS || !srv->slot[id].open)
+   {
+      RTPS_perror("Window not created.");
+      if (0 == strcmp(cmd->valuestring, "attach"))
+         RTPS_server_reply_status(client, "attach", rc, id);
+   }
+   else if (0 == strcmp(cmd->valuestring, "attach"))
+   {
+      if ((rc = RTPS_server_attach(srv, client, root, id)) < 0)
+         RTPS_perror("Shared memory attach.");
+      RTPS_server_reply_status(client, "attach", rc, id);
+   }
+   else if (0 == strcmp(cmd->valuestring, "destroy"))
+   {
+      void *ev = RTPS_event_reserve(srv, RTPS_EVENT_DESTROY, id, 0, 0);
+      if (ev != NULL)
+      {
+         RTPS_event_commit(srv, ev, 0, 0);
+         srv->slot[id].open = false;
+         srv->slot[id].latency = NULL;
+         rc = 0;
+      }
+   }
+   else
+   {
+      RTPS_perror("unrecognized command.");
+   }
+
+_err_ret:
+   cJSON_Delete(root);
+   return rc;   
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_drop_client(RTPS_Server *srv, RTPS_Client *client)
+ *
+ *  @brief	Close a client and release its state
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_server_drop_client(RTPS_Server *srv, RTPS_Client *client)
+{
+   epoll_ctl(srv->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+   close(client->fd);
+
+   for (int i = 0; i < srv->client_count; i++)
+   {
+      if (srv->clients[i] == client)
+      {
+         srv->clients[i] = srv->clients[--srv->client_count];
+         break;
+      }
+   }
+   free(client->rx.buf);
+   free(client);
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		void RTPS_server_accept(RTPS_Server *srv)
+ *
+ *  @brief	Accept every pending connection and register it with epoll
+ *
+ *---------------------------------------------------------------------------------------
+ */
+static
+void RTPS_server_accept(RTPS_Server *srv)
+{
+   int fd;
+
+   while ((fd = accept4(srv->conn->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+   {
+      RTPS_Client *client = NULL;
+
+      if (srv->client_count >= MAX_CLIENTS ||
+          (client = calloc(1, sizeof(RTPS_Client))) == NULL)
+      {
+         RTPS_perror("Too many clients.");
+         close(fd);
+         continue;
+      }
+      client->fd = fd;
+      client->packet = (srv->conn->type == SOCK_SEQPACKET);
+
+      struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = client };
+      if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+      {
+         close(fd);
+         free(client);
+         continue;
+      }
+      srv->clients[srv->client_count++] = client;
+   }
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_ingest_client(RTPS_Server *srv, RTPS_Client *client)
+ *
+ *  @brief	Read once from a ready client and process every complete message
+ *
+ *  A trailing partial message is kept in the client's receive buffer for the next
+ *  call.
+ *
+ *  @param	srv	RTPS_Server pointer 
+ *  @param	client	Readable client
+ *
+ *  @return	0 if successful; negative if the client was dropped
+ *  
+ *---------------------------------------------------------------------------------------
+ */
+static
+int RTPS_server_ingest_client(RTPS_Server *srv, RTPS_Client *client)
+{
+   int rc;	
+   uint8_t *payload;
+   size_t len, pos = 0;
+   RTPS_RxBuffer *rx = &client->rx;
+
+   if (RTPS_server_recv(client->fd, rx, client->packet) < 0)
+   {
+      RTPS_server_drop_client(srv, client);
+      return -1;
+   }
+   srv->rx_ns = RTPS_clock_ns();
+
+   while ((rc = RTPS_server_next_frame(rx, &pos, &payload, &len)) > 0)
+   {
+      atomic_fetch_add_explicit(&srv->rx_messages, 1, memory_order_relaxed);
+      atomic_fetch_add_explicit(&srv->rx_bytes, RTPS_FRAME_HDR_LEN + len, memory_order_relaxed);
+      if (RTPS_server_dispatch(srv, client, payload, len) < 0)
+         atomic_fetch_add_explicit(&srv->rx_errors, 1, memory_order_relaxed);
+      if (client->broken)
+      {
+         RTPS_perror("Reply not sent.");
+         RTPS_server_drop_client(srv, client);
+         return -1;
+      }
+   }
+
+   if (rc < 0)
+   {
+      RTPS_perror("Message exceeds maximum frame length.");
+      RTPS_server_drop_client(srv, client);
+      return -1;
+   }
+
+   // Packets carry whole frames; the rest of this one will never arrive
+   if (client->packet && pos < rx->len)
+   {
+      RTPS_perror("Packet ends inside a frame.");
+      RTPS_server_drop_client(srv, client);
+      return -1;
+   }
+
+   // Keep the trailing partial message at the front of the buffer
+   if (pos > 0)
+   {
+      memmove(rx->buf, rx->buf + pos, rx->len - pos);
+      rx->len -= pos;
+   }
+   return 0;
+}
+
 
 
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		void RTPS_disconnect(RTPS_Connection *conn)
+ *  @fn         int RTPS_server_datagram(RTPS_Server *srv, const uint8_t *buf, size_t len,
+ *                                       const struct sockaddr_in *from)
  *
- *  @brief	Disconnect from RTPS
+ *  @brief      Check a datagram's sequence number and queue its points
+ *
+ *  Datagrams missing from the sequence are counted and a point with NaN values is
+ *  queued in their place, so the trace shows the gap. Datagrams that arrive after
+ *  a later one are dropped, as are all of them while the render queue is more than
+ *  half full: with UDP it is better to lose data than to fall behind. Those are
+ *  counted by the caller, not again as missing. A sequence starting over at 0 or
+ *  coming from another address is taken as a restarted sender.
+ *
+ *  return       0 success
+ *              -1 runt or malformed datagram
+ *              -2 late or duplicate datagram
+ *              -3 render queue backed up
+ *              other negative values from RTPS_plot_binary()
  *
  *---------------------------------------------------------------------------------------
  */
-void RTPS_disconnect(RTPS_Connection *conn)
+static
+int RTPS_server_datagram(RTPS_Server *srv, const uint8_t *buf, size_t len,
+                         const struct sockaddr_in *from)
 {
-   if (conn != NULL)
+   RTPS_BinHeader hdr;
+   const uint8_t *msg = buf + RTPS_UDP_HDR_LEN;
+
+   srv->rx_sent_ns = 0;
+   if (len < RTPS_UDP_HDR_LEN) return -1;
+   if (RTPS_bin_to_header(msg, len - RTPS_UDP_HDR_LEN, &hdr) < 0 || hdr.type != RTPS_MSG_PLOT)
+      return -1;
+   if (hdr.window >= MAX_WINDOWS || !srv->slot[hdr.window].open ||
+       hdr.y_count != srv->slot[hdr.window].y_count || hdr.count == 0)
+   {
+      return -1;
+   }
+
+   RTPS_WindowSlot *slot = &srv->slot[hdr.window];
+   uint32_t seq = RTPS_get_le32(buf);
+
+   // A sender that restarted counts from scratch
+   if (slot->udp_synced && (seq == 0 || from->sin_port != slot->udp_from.sin_port ||
+                            from->sin_addr.s_addr != slot->udp_from.sin_addr.s_addr))
+   {
+      slot->udp_synced = false;
+   }
+   int32_t ahead = slot->udp_synced ? (int32_t)(seq - slot->udp_seq) : 0;
+   if (ahead < 0 && ahead >= -UDP_REORDER_LIMIT) return -2;
+
+   // Left out of the sequence, so the next datagram shows the gap
+   if (spsc_used(srv->queue) > srv->queue->sz / 2)
+   {
+      if (slot->udp_synced && ahead >= 0) slot->udp_shed++;
+      return -3;
+   }
+
+   uint32_t shed = slot->udp_synced ? slot->udp_shed : 0;
+   slot->udp_synced = true;
+   slot->udp_seq = seq + 1;
+   slot->udp_shed = 0;
+   slot->udp_from = *from;
+
+   if (ahead != 0)
    {
-      close(conn->fd);
+      if (ahead > 0 && (uint32_t)ahead > shed)
+         atomic_fetch_add(&srv->udp_lost, (unsigned long)ahead - shed);
+
+      double *col = RTPS_event_reserve(srv, RTPS_EVENT_PLOT, hdr.window, 1,
+                                       RTPS_PLOT_EVENT_LEN(1, hdr.y_count));
+      if (col == NULL) return -3;
+      col[0] = RTPS_get_f64(msg + RTPS_BIN_DATA_OFF(hdr.flags));
+      for (int j = 0; j < hdr.y_count; j++)
+         col[j+1] = NAN;
+      RTPS_event_commit(srv, col, 1, RTPS_PLOT_EVENT_LEN(1, hdr.y_count));
    }
+
+   return RTPS_plot_binary(msg, len - RTPS_UDP_HDR_LEN, srv);
 }
 
 
+
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_client_send(RTPS_Connection *conn, 
- *                                   RTPS_Window *win, 
- *                                   DataPoint *data)
- *
- *  @brief	Send a DataPoint 
- *
- *  @param	conn		RTPS_Connection
- *  @param	win		Pointer to RTPS_Window 
- *  @param	data		Pointer to DataPoint
+ *  @fn         void RTPS_server_ingest_udp(RTPS_Server *srv)
  *
- *  @return	0 if successful; negative otherwise
+ *  @brief      Receive every pending datagram, UDP_RECV_BATCH per system call
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_client_send(RTPS_Connection *conn, RTPS_Window *win, DataPoint *data)
+static
+void RTPS_server_ingest_udp(RTPS_Server *srv)
 {
-   if (conn == NULL || win == NULL || data == NULL) return -1;
+   struct mmsghdr msgs[UDP_RECV_BATCH];
+   struct iovec iov[UDP_RECV_BATCH];
+   struct sockaddr_in from[UDP_RECV_BATCH];
+   int n;
 
-   cJSON *cdata = cJSON_CreateObject();
-   if (cdata == NULL) return -2;
-
-   if (0 == RTPS_data_to_cjson(data, cdata, win))
+   do
    {
-      char message[MAX_JSON_LEN] = {0};
-      memset(message, 0, sizeof(message));
-      char *json_str = cJSON_Print(cdata);
-      if (json_str != NULL)
+      for (int i = 0; i < UDP_RECV_BATCH; i++)
+      {
+         iov[i].iov_base = srv->udp_buf + (size_t)i * RTPS_UDP_MAX_LEN;
+         iov[i].iov_len = RTPS_UDP_MAX_LEN;
+         msgs[i].msg_hdr = (struct msghdr){ .msg_name = &from[i], .msg_namelen = sizeof(from[i]),
+                                            .msg_iov = &iov[i], .msg_iovlen = 1 };
+      }
+
+      if ((n = recvmmsg(srv->udp_fd, msgs, UDP_RECV_BATCH, MSG_DONTWAIT, NULL)) <= 0) break;
+      srv->rx_ns = RTPS_clock_ns();
+
+      for (int i = 0; i < n; i++)
       {
-         strcpy(message, json_str);
-         free(json_str);
-         send(conn->fd, message, strlen(message), 0);
+         atomic_fetch_add_explicit(&srv->rx_messages, 1, memory_order_relaxed);
+         atomic_fetch_add_explicit(&srv->rx_bytes, msgs[i].msg_len, memory_order_relaxed);
+         if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ||
+             RTPS_server_datagram(srv, iov[i].iov_base, msgs[i].msg_len, &from[i]) < 0)
+         {
+            atomic_fetch_add(&srv->udp_dropped, 1);
+         }
       }
    }
-   cJSON_Delete(cdata);
-   return 0;
+   while (n == UDP_RECV_BATCH && atomic_load(&srv->running));
 }
 
 
@@ -616,43 +4838,30 @@ int RTPS_client_send(RTPS_Connection *conn, RTPS_Window *win, DataPoint *data)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_client_create_plot(RTPS_Connection *conn, RTPS_Window *plot)
- *  
- *  @brief	Initialize plot
+ *  @fn		void RTPS_server_reap(RTPS_Server *srv)
  *
- *  @param	conn		Instantiated RTPS_Connection pointer
- *  @param	plot		Instantiated RTPS_Window pointer
+ *  @brief	Close the handles of windows the render thread could not open
  *
- *  @return	0 if success; negative otherwise
+ *  Later data for them is rejected like that of any closed window.
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_client_create_plot(RTPS_Connection *conn, RTPS_Window *plot)
+static
+void RTPS_server_reap(RTPS_Server *srv)
 {
-   int rc = -1;
-   if (conn == NULL || plot == NULL) goto _err_ret; 
-
-   cJSON *root = cJSON_CreateObject();
-   if (root != NULL)
+   for (int id = 0; id < MAX_WINDOWS; id++)
    {
-      if (0 == RTPS_win_to_cjson(plot, root))
-      {
-         char *json_str = cJSON_Print(root);
-         if (json_str != NULL)
-         {
-            char message[MAX_JSON_LEN];
-            memset(message, 0, sizeof(message));
-            strcpy(message, json_str);
-            send(conn->fd, message, strlen(message), 0);
-            free(json_str);
-	    rc = 0;
-         }
-      }
-      cJSON_Delete(root);
-   }
+      RTPS_WindowSlot *slot = &srv->slot[id];
 
-_err_ret:
-   return rc;
+      // A handle closed and created again since is not the one that failed
+      if (!slot->open || atomic_load(&srv->open_failed[id]) != slot->gen) continue;
+
+      void *ev = RTPS_event_reserve(srv, RTPS_EVENT_DESTROY, id, 0, 0);
+      if (ev == NULL) return;
+      RTPS_event_commit(srv, ev, 0, 0);
+      slot->open = false;
+      slot->latency = NULL;
+   }
 }
 
 
@@ -660,39 +4869,40 @@ _err_ret:
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_server_create(cJSON *root, RTPS_Window *window)
- *
- *  @brief      Create a new plot window from JSON
- *
- *  @param      root    cJSON root
- *  @param      window  Pointer to instantiated RTPS_Window
+ *  @fn		void *RTPS_server_ingest(void *arg)
  *
- *  @return     0 if successful; negative otherwise
+ *  @brief	Ingest thread: multiplex the listener, the datagram socket and all clients
+ *              until stopped
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_server_create(cJSON *root, RTPS_Window *window)
+static
+void *RTPS_server_ingest(void *arg)
 {
-   if (root == NULL) return -1;
+   RTPS_Server *srv = (RTPS_Server *)arg;
+   struct epoll_event events[64];
 
-   if (0 == RTPS_cjson_to_win(root, window))
+   while (atomic_load(&srv->running))
    {
-      // Init the Circular Buffer
-      int max_points = (int)floor(window->x_range / window->x_step);
-      cb_init(&window->cb, MAX_Y_PLOTS, max_points);
+      int n = epoll_wait(srv->epfd, events, sizeof(events)/sizeof(events[0]), INGEST_POLL_MS);
 
-      // Create & attach to SDL window/renderer
-      window->sdlwin = SDL_CreateWindow(window->title,
-                                        SDL_WINDOWPOS_CENTERED, // x pos
-                                        SDL_WINDOWPOS_CENTERED, // y pos
-                                        window->width,
-                                        window->height,
-                                        SDL_WINDOW_SHOWN);
+      RTPS_server_reap(srv);
 
-      window->sdlrendr = SDL_CreateRenderer(window->sdlwin, -1, SDL_RENDERER_ACCELERATED);
-      return 0;
+      for (int i = 0; i < n; i++)
+      {
+         RTPS_Client *client = (RTPS_Client *)events[i].data.ptr;
+
+         if (client == NULL)
+            RTPS_server_accept(srv);
+         else if ((void *)client == &srv->udp_fd)
+            RTPS_server_ingest_udp(srv);
+         else if (events[i].events & EPOLLIN)
+            RTPS_server_ingest_client(srv, client);
+         else
+            RTPS_server_drop_client(srv, client);
+      }
    }
-   return -2;
+   return NULL;
 }
 
 
@@ -700,109 +4910,144 @@ int RTPS_server_create(cJSON *root, RTPS_Window *window)
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		void RTPS_server_init()
- *  
- *  @brief	Initialize RTPS server
+ *  @fn		void RTPS_server_close_udp(RTPS_Server *srv)
+ *
+ *  @brief	Close the datagram socket and free its receive buffer
  *
  *---------------------------------------------------------------------------------------
  */
-void RTPS_server_init()
+static
+void RTPS_server_close_udp(RTPS_Server *srv)
 {
-   SDL_Init(SDL_INIT_VIDEO);
+   if (srv->udp_fd >= 0) close(srv->udp_fd);
+   free(srv->udp_buf);
+   srv->udp_fd = -1;
+   srv->udp_buf = NULL;
 }
 
 
+
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_server_shutdown(RTPS_Window *win)
- *  
- *  @brief	RTPS server shutdown
+ *  @fn		int RTPS_server_start(RTPS_Server *srv, RTPS_Connection *conn)
  *
- *  @param	win	RTPS_Window pointer 
+ *  @brief	Start the ingest thread
  *
- *  @return	0 if successful; negative otherwise
+ *  @param	srv	Pointer to zeroed RTPS_Server
+ *  @param	conn	Listening RTPS_Connection; used only by the ingest thread
  *
+ *  @return	0 if successful; negative otherwise
+ *  
  *---------------------------------------------------------------------------------------
  */
-int RTPS_server_shutdown(RTPS_Window *win)
+int RTPS_server_start(RTPS_Server *srv, RTPS_Connection *conn)
 {
-   if (win == NULL) return -1;
+   if (srv == NULL || conn == NULL) return -1;
 
-   SDL_DestroyRenderer(win->sdlrendr);
-   SDL_DestroyWindow(win->sdlwin);
-   SDL_Quit();
+   srv->conn = conn;
+   srv->client_count = 0;
+   memset(srv->slot, 0, sizeof(srv->slot));
+   atomic_init(&srv->queue_stalls, 0);
+   atomic_init(&srv->udp_lost, 0);
+   atomic_init(&srv->udp_dropped, 0);
+
+   if ((srv->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) return -2;
+
+   struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+   if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) goto _err_epoll;
+
+   // Datagrams on the same port; the server runs without them if the port is taken
+   srv->udp_fd = -1;
+   srv->udp_buf = NULL;
+   if (conn->unix_address.sun_family != AF_UNIX)
+   {
+      srv->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      srv->udp_buf = malloc((size_t)UDP_RECV_BATCH * RTPS_UDP_MAX_LEN);
+      struct epoll_event uev = { .events = EPOLLIN, .data.ptr = &srv->udp_fd };
+      if (srv->udp_fd < 0 || srv->udp_buf == NULL ||
+          bind(srv->udp_fd, (struct sockaddr *)&conn->address, sizeof(conn->address)) < 0 ||
+          epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->udp_fd, &uev) < 0)
+      {
+         RTPS_perror("UDP disabled.");
+         RTPS_server_close_udp(srv);
+      }
+   }
+
+   if ((srv->queue = spsc_create(EVENT_QUEUE_LEN)) == NULL) goto _err_epoll;
 
+   atomic_init(&srv->running, true);
+   if (pthread_create(&srv->ingest, NULL, RTPS_server_ingest, srv) != 0)
+   {
+      atomic_store(&srv->running, false);
+      spsc_free(srv->queue);
+      srv->queue = NULL;
+      goto _err_epoll;
+   }
    return 0;
+
+_err_epoll:
+   RTPS_server_close_udp(srv);
+   close(srv->epfd);
+   srv->epfd = -1;
+   return -3;
 }
 
+
+
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		bool RTPS_server_forced_exit()
+ *  @fn		int RTPS_server_stop(RTPS_Server *srv)
  *
- *  @return	true if forced exit
+ *  @brief	Stop and join the ingest thread, closing every client
+ *
+ *  @param	srv	RTPS_Server pointer
  *
+ *  @return	0 if successful; negative otherwise
+ *  
  *---------------------------------------------------------------------------------------
  */
-bool RTPS_server_forced_exit()
+int RTPS_server_stop(RTPS_Server *srv)
 {
-   SDL_Event e;
-   while (SDL_PollEvent(&e))
-      if (e.type == SDL_QUIT)
-         return true;
+   if (srv == NULL || srv->queue == NULL) return -1;
 
-   return false;
+   atomic_store(&srv->running, false);
+   pthread_join(srv->ingest, NULL);
+
+   while (srv->client_count > 0)
+      RTPS_server_drop_client(srv, srv->clients[0]);
+   RTPS_server_close_udp(srv);
+   close(srv->epfd);
+   srv->epfd = -1;
+
+   spsc_free(srv->queue);
+   srv->queue = NULL;
+   return 0;
 }
 
 
+
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_wait_for_connection(RTPS_Connection *conn, int port)
- *
- *  @brief      Initialize Real-Time Plot Server
+ *  @fn		void RTPS_server_gauge(RTPS_Server *srv, RTPS_Window *win, size_t lost)
  *
- *  @param      conn    Pointer to instantiated RTPS_Connection
- *  @param      port    TCP port number
- *
- *  @return     0 if success; negative otherwise
+ *  @brief	Publish a window's buffer fill after a push that overwrote lost points
  *
  *---------------------------------------------------------------------------------------
  */
-int RTPS_wait_for_connection(RTPS_Connection *conn, int port)
+static
+void RTPS_server_gauge(RTPS_Server *srv, RTPS_Window *win, size_t lost)
 {
-   conn->connected = false;
-   conn->fd = socket(AF_INET, SOCK_STREAM, 0);
-   if (conn->fd < 0)
-   {
-     RTPS_perror("Socket failed.");
-     goto _err_ret;
-   }
-
-   conn->port = port;
-   conn->address.sin_family = AF_INET;
-   conn->address.sin_addr.s_addr = INADDR_ANY;
-   conn->address.sin_port = htons(conn->port);
-
-   if (bind(conn->fd, (struct sockaddr*)&conn->address, sizeof(conn->address)) < 0)
-   {
-      RTPS_perror("Bind failed");
-      goto _err_ret;
-   }
+   RTPS_WindowGauge *g = &srv->gauge[win->id];
 
-   int addrlen = sizeof(conn->address);
-   if (listen(conn->fd, 1) < 0)
+   atomic_store_explicit(&g->fill, cb_count(&win->cb), memory_order_relaxed);
+   if (lost > 0)
    {
-      RTPS_perror("Listen failed");
-      goto _err_ret;
+      atomic_fetch_add_explicit(&g->overwrites, lost, memory_order_relaxed);
+      atomic_fetch_add_explicit(&srv->overwrites, lost, memory_order_relaxed);
    }
-   conn->client = accept(conn->fd, (struct sockaddr*)&conn->address, (socklen_t*)&addrlen);
-   return 0;
-
-_err_ret:
-   RTPS_disconnect(conn);
-   return -1;
 }
 
 
@@ -810,135 +5055,296 @@ _err_ret:
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn         int RTPS_plot(cJSON *root, DataPoint *data)
+ *  @fn		int RTPS_server_drain_shm(RTPS_Server *srv, RTPS_Window *win)
  *
- *  @brief      Plot a new point
+ *  @brief	Push the points a client wrote into the window's shared-memory ring
  *
- *  return       0 success
- *              -1 root or data is NULL
- *              -2 cannot find 'window' key
- *              -3 cannot find 'data' key
- *              -4 cJSON to data conversion error
- *              -5 specified window not found
+ *  A record that does not fit the mapping or the window's series detaches the
+ *  ring. The ring is the whole transport, so a timestamped record reaches the
+ *  receive, parse and queue stages together as it is read.
+ *
+ *  @param	srv	RTPS_Server pointer
+ *  @param	win	Window with a ring attached
  *
+ *  @return	Number of records applied
+ *  
  *---------------------------------------------------------------------------------------
  */
 static
-int RTPS_plot(cJSON *root, RTPS_Window *window)
+int RTPS_server_drain_shm(RTPS_Server *srv, RTPS_Window *win)
 {
-   int rc = -5;
-   cJSON *wdata;
-
-   if (root == NULL || window == NULL) return -1;
-
-   if ((wdata = cJSON_extract(root, 'a', "data")) == NULL)
-      return -2;
-
-   DataPoint data = {0};
-   rc = RTPS_cjson_to_data(wdata, &data);
-   if (rc < 0) return -3;
-
-   cb_push(&window->cb, data);
-   double x_offset = data.x - window->x_range;
-
-   SDL_SetRenderDrawColor(window->sdlrendr, 255, 255, 255, 255);
-   SDL_RenderClear(window->sdlrendr);
-
-   draw_grid(window, x_offset);
-   draw_axes(window, x_offset);
-   draw_plot(window, x_offset);
-   draw_title(window);
+   int records = 0;
+   int rc;
+   size_t len;
+   void *p;
+   const double *y[MAX_Y_PLOTS];
+   size_t pt = RTPS_PLOT_EVENT_LEN(1, win->y_count);
+
+   while ((rc = spsc_reader_peek(&win->shm_rd, &p, &len)) != 0)
+   {
+      const uint64_t *rec = p;
+      if (rc < 0 || len < sizeof(uint64_t) || (len - sizeof(uint64_t)) % pt != 0)
+      {
+         RTPS_perror("Shared memory ring corrupt.");
+         munmap(win->shm, win->shm_len);
+         win->shm = NULL;
+         return records;
+      }
 
-   // Axis labels
-   stringRGBA(window->sdlrendr,
-              window->width/2 - 30, window->height - 35,
-              window->x_label,
-              0, 0, 0, 255);
+      uint64_t sent = rec[0];
+      const double *x = (const double *)(rec + 1);
+      size_t n = (len - sizeof(uint64_t)) / pt;
+      for (int j = 0; j < win->y_count; j++)
+         y[j] = x + (j+1) * n;
+      RTPS_server_gauge(srv, win, cb_push_n(&win->cb, x, y, n));
+      spsc_reader_release(&win->shm_rd);
+      records++;
 
-   stringRGBA(window->sdlrendr,
-              10, window->height/2,
-              window->y_label,
-              0, 0, 0, 255);
+      if (sent != 0 && n > 0 && win->latency != NULL)
+      {
+         uint64_t now = RTPS_clock_ns();
+         for (int s = RTPS_STAGE_RECV; s <= RTPS_STAGE_QUEUE; s++)
+            RTPS_latency_add(win->latency, s, now, sent, (uint32_t)n);
+         RTPS_window_stamp(win, sent, (uint32_t)n);
+      }
 
-   SDL_RenderPresent(window->sdlrendr);
-   SDL_Delay((int)window->x_step*1000);
+      win->dirty = true;
+      srv->dirty = true;
+      if (RTPS_clock_ns() >= next_frame_ns) break;
+   }
 
-   return rc;   // window not found
+   return records;
 }
 
 
 
-
 /*!
  *---------------------------------------------------------------------------------------
  *
- *  @fn		int RTPS_server_update(RTPS_Connection *conn)
+ *  @fn		int RTPS_server_update(RTPS_Server *srv)
  *
  *  @brief	RTPS server loop update
  *
- *  @param	conn	RTPS_Connection pointer 
- *  @param	win	RTPS_Window pointer
+ *  Applies the events decoded by the ingest thread: opens and closes windows and
+ *  pushes points into their circular buffers, then drains the shared-memory rings
+ *  of attached clients. Draining stops early once a frame is
+ *  due so a flood of data cannot starve rendering. Drawing is left to
+ *  RTPS_server_render().
  *
- *  @return	0 if successful; negative otherwise
+ *  @param	srv	RTPS_Server pointer
+ *
+ *  @return	Number of events applied; negative on error
  *  
  *---------------------------------------------------------------------------------------
  */
-int RTPS_server_update(RTPS_Connection *conn, RTPS_Window *win)
+int RTPS_server_update(RTPS_Server *srv)
 {
-   int rc = -1;	
-   static bool win_created = false;
-   cJSON *root, *cmd;
-   char message[MAX_JSON_LEN];
+   int events = 0;
+   size_t len;
+   RTPS_Event *ev;
 
-   if (conn == NULL || win == NULL) goto _err_ret;
+   if (srv == NULL || srv->queue == NULL) return -1;
 
-   memset(message, 0, sizeof(message));
-   if (0 == RTPS_server_recv(conn->client,  message, sizeof(message)))
+   while ((ev = spsc_peek(srv->queue, &len)) != NULL)
    {
-      // Parse JSON string 
-      if ((root = cJSON_Parse(message)) == NULL) goto _err_ret;
+      RTPS_Window *win = srv->win[ev->window];
 
-      // Check for command
-      if ((cmd = cJSON_extract(root, 's', "cmd")) == NULL) goto _err_ret;
-      
-      // Parse and process different command type 
-      if (0 == strcmp(cmd->valuestring, "create"))
+      if (ev->type == RTPS_EVENT_CREATE && win == NULL)
       {
-         if (win_created)
+         RTPS_Window *cfg = (RTPS_Window *)(ev + 1);
+
+         if ((win = malloc(sizeof(RTPS_Window))) == NULL)
+            cb_free(&cfg->cb);
+         else
          {
-            RTPS_perror("Window already created.");
+            *win = *cfg;
+            win->latency = NULL;
+            if (RTPS_server_open_renderer(win) < 0)
+            {
+               RTPS_server_close(win);
+               free(win);
+               win = NULL;
+            }
+            else
+               win->latency = cfg->latency;
          }
-         else if ((rc = RTPS_server_create(root, win)) == 0)
+
+         if (win != NULL)
          {
-            win_created = true;
+            srv->win[ev->window] = win;
+
+            RTPS_WindowGauge *g = &srv->gauge[ev->window];
+            atomic_store(&g->fill, 0);
+            atomic_store(&g->capacity, win->cb.sz);
+            atomic_store(&g->overwrites, 0);
+            srv->dirty = true;
          }
          else
          {
-            RTPS_perror("Window create.");
+            // Already acknowledged: the ingest thread closes the handle and sends
+            // "destroy", recording latency until then
+            RTPS_perror("Window open.");
+            srv->orphan[ev->window] = cfg->latency;
+            atomic_fetch_add(&srv->open_errors, 1);
+            atomic_store(&srv->open_failed[ev->window], cfg->gen);
          }
       }
-      else if (0 == strcmp(cmd->valuestring, "plot"))
+      else if (ev->type == RTPS_EVENT_CREATE)
+      {
+         free(((RTPS_Window *)(ev + 1))->latency);
+         cb_free(&((RTPS_Window *)(ev + 1))->cb);
+      }
+      else if (ev->type == RTPS_EVENT_PLOT && win != NULL && win->sdlrendr != NULL)
+      {
+         const double *x = (const double *)(ev + 1);
+         const double *y[MAX_Y_PLOTS];
+         for (int j = 0; j < win->y_count; j++)
+            y[j] = x + (j+1) * ev->count;
+         RTPS_server_gauge(srv, win, cb_push_n(&win->cb, x, y, ev->count));
+         if (ev->sent_ns != 0) RTPS_window_stamp(win, ev->sent_ns, ev->count);
+         win->dirty = true;
+         srv->dirty = true;
+      }
+      else if (ev->type == RTPS_EVENT_ATTACH)
       {
-         if (win_created)
+         RTPS_ShmMap *map = (RTPS_ShmMap *)(ev + 1);
+         if (win != NULL && win->sdlrendr != NULL && win->shm == NULL)
          {
-            rc = RTPS_plot(root, win);
+            win->shm = map->ring;
+            win->shm_len = map->len;
+            win->shm_rd = map->rd;
          }
          else
          {
-            RTPS_perror("Window not created.");
+            munmap(map->ring, map->len);
          }
       }
-      else if (0 == strcmp(cmd->valuestring, "destroy"))
+      else if (ev->type == RTPS_EVENT_DESTROY && win != NULL)
       {
-         rc = 0;
+         // Data written before "destroy" is still shown
+         while (win->shm != NULL && RTPS_server_drain_shm(srv, win) > 0);
+         RTPS_server_close(win);
+         free(win);
+         srv->win[ev->window] = NULL;
       }
-      else
+      else if (ev->type == RTPS_EVENT_DESTROY)
       {
-         RTPS_perror("unrecognized command.");
+         free(srv->orphan[ev->window]);
+         srv->orphan[ev->window] = NULL;
       }
-   } // if (recv)
+      spsc_release(srv->queue);
+      events++;
 
-_err_ret:
-   return rc;   
+      if (srv->dirty && RTPS_clock_ns() >= next_frame_ns) break;
+   }
+
+   // Shared-memory producers, drained after the events that attached them
+   for (int i = 0; i < MAX_WINDOWS; i++)
+   {
+      if (srv->win[i] != NULL && srv->win[i]->shm != NULL)
+         events += RTPS_server_drain_shm(srv, srv->win[i]);
+   }
+
+   // Nothing to apply or draw yet
+   if (events == 0 && (!srv->dirty || RTPS_clock_ns() < next_frame_ns))
+      SDL_Delay(1);
+
+   return events;
+}
+
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_render(RTPS_Server *srv)
+ *
+ *  @brief	Redraw every window that has new data once a frame is due
+ *
+ *  All windows share one render tick. The time spent drawing and presenting is
+ *  added to srv->frames; in headless mode frames are also dumped when due.
+ *
+ *  @param	srv	RTPS_Server pointer
+ *
+ *  @return	Number of windows presented; negative on error
+ *  
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_render(RTPS_Server *srv)
+{
+   int presented = 0;
+
+   if (srv == NULL) return -1;
+   if (!srv->dirty) return 0;
+
+   uint64_t now = RTPS_clock_ns();
+   if (now < next_frame_ns) return 0;
+
+   uint64_t frame_ns = 0;
+   for (int i = 0; i < MAX_WINDOWS; i++)
+   {
+      RTPS_Window *win = srv->win[i];
+      if (win == NULL || win->sdlrendr == NULL || !win->dirty) continue;
+
+      uint64_t t0 = RTPS_clock_ns();
+      RTPS_redraw(win);
+      win->frame_ns = RTPS_clock_ns() - t0;
+      frame_ns += win->frame_ns;
+      win->dirty = false;
+      presented++;
+
+      // Dumps are left out of the frame time
+      if (dump_dir != NULL && win->surface != NULL && t0 >= win->next_dump_ns)
+      {
+         RTPS_server_dump(win);
+         win->next_dump_ns = t0 + dump_interval_ns;
+      }
+      win->frame_count++;
+   }
+   srv->dirty = false;
+   next_frame_ns = now + frame_interval_ns;
+
+   if (presented > 0)
+   {
+      atomic_fetch_add(&srv->frames.count, 1);
+      atomic_store(&srv->frames.last_ns, frame_ns);
+      atomic_fetch_add(&srv->frames.total_ns, frame_ns);
+      if (frame_ns > atomic_load(&srv->frames.max_ns)) atomic_store(&srv->frames.max_ns, frame_ns);
+   }
+
+   return presented;
 }
 
+
+
+/*!
+ *---------------------------------------------------------------------------------------
+ *
+ *  @fn		int RTPS_server_get_latency(RTPS_Server *srv, int id, int stage,
+ *                                          RTPS_LatencyStats *stats)
+ *
+ *  @brief	Latency of a window's timestamped data up to one stage
+ *
+ *  @param	srv	RTPS_Server pointer
+ *  @param	id	Window handle
+ *  @param	stage	RTPS_STAGE_*
+ *  @param	stats	Sample count and percentiles, in nanoseconds
+ *
+ *  @return	0 if successful; negative otherwise
+ *  
+ *---------------------------------------------------------------------------------------
+ */
+int RTPS_server_get_latency(RTPS_Server *srv, int id, int stage, RTPS_LatencyStats *stats)
+{
+   if (srv == NULL || stats == NULL) return -1;
+   if (id < 0 || id >= MAX_WINDOWS || srv->win[id] == NULL || srv->win[id]->latency == NULL) return -2;
+   if (stage < 0 || stage >= RTPS_STAGES) return -3;
+
+   const LatencyHist *h = &srv->win[id]->latency->stage[stage];
+   stats->count   = lh_count(h, NULL);
+   stats->p50_ns  = lh_percentile(h, NULL, 0.50);
+   stats->p99_ns  = lh_percentile(h, NULL, 0.99);
+   stats->p999_ns = lh_percentile(h, NULL, 0.999);
+   stats->max_ns  = atomic_load_explicit(&h->max, memory_order_relaxed);
+   return 0;
+}
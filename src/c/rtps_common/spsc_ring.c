@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spsc_ring.h>
+
+
+#define SPSC_PAD                0xFFFFFFFFu
+#define SPSC_ALIGN(n)           (((n) + 7) & ~(size_t)7)
+
+
+//-------------------------------------------------------------------------
+// Record header, stored in front of every record
+//-------------------------------------------------------------------------
+typedef struct {
+    uint32_t len;
+    uint32_t reserved;
+} SpscRecord;
+
+
+//-------------------------------------------------------------------------
+// Create a ring of sz bytes, rounded up to a power of two
+//-------------------------------------------------------------------------
+SpscRing *spsc_create(size_t sz)
+{
+    size_t cap = 64;
+    while (cap < sz)
+        cap <<= 1;
+
+    SpscRing *ring = aligned_alloc(SPSC_CACHE_LINE, sizeof(SpscRing) + cap);
+    if (ring == NULL)
+        return NULL;
+
+    memset(ring, 0, sizeof(SpscRing));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->sz = cap;
+    return ring;
+}
+
+
+//-------------------------------------------------------------------------
+// Lay a ring out in len bytes of caller memory, e.g. a shared mapping.
+// The ring uses the largest power of two that fits; the memory is not freed
+// by spsc_free(). Returns NULL if len is too small.
+//-------------------------------------------------------------------------
+SpscRing *spsc_init(void *mem, size_t len)
+{
+    if (mem == NULL || len < sizeof(SpscRing) + 64)
+        return NULL;
+
+    size_t cap = 64;
+    while (cap * 2 <= len - sizeof(SpscRing))
+        cap <<= 1;
+
+    SpscRing *ring = mem;
+    memset(ring, 0, sizeof(SpscRing));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->sz = cap;
+    return ring;
+}
+
+
+//-------------------------------------------------------------------------
+// Check that a ring of sz bytes fits in len bytes
+//-------------------------------------------------------------------------
+static bool spsc_fits(size_t sz, size_t len)
+{
+    return len >= sizeof(SpscRing) && sz >= 64 && (sz & (sz - 1)) == 0 &&
+           sz <= len - sizeof(SpscRing);
+}
+
+
+//-------------------------------------------------------------------------
+// Check that a ring laid out by another process fits in len bytes
+//-------------------------------------------------------------------------
+bool spsc_valid(const SpscRing *ring, size_t len)
+{
+    return spsc_fits(ring->sz, len);
+}
+
+
+//-------------------------------------------------------------------------
+// Free the ring
+//-------------------------------------------------------------------------
+void spsc_free(SpscRing *ring)
+{
+    free(ring);
+}
+
+
+//-------------------------------------------------------------------------
+// Producer: reserve contiguous space for a record of len bytes
+// Returns pointer to the record payload, NULL if the ring is full
+//-------------------------------------------------------------------------
+void *spsc_reserve(SpscRing *ring, size_t len)
+{
+    size_t need = SPSC_REC_HDR_LEN + SPSC_ALIGN(len);
+    if (need > ring->sz / 2)
+        return NULL;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t idx = head & (ring->sz - 1);
+    size_t contig = ring->sz - idx;
+
+    // Not enough room before the end: pad out the rest and start at 0
+    size_t pad = (contig < need) ? contig : 0;
+    if (head + pad + need - tail > ring->sz)
+        return NULL;
+
+    if (pad > 0)
+    {
+        ((SpscRecord *)(ring->data + idx))->len = SPSC_PAD;
+        idx = 0;
+    }
+
+    ((SpscRecord *)(ring->data + idx))->len = (uint32_t)len;
+    ring->res_pad = pad;
+    ring->res_len = len;
+    return ring->data + idx + SPSC_REC_HDR_LEN;
+}
+
+
+//-------------------------------------------------------------------------
+// Producer: publish the reserved record, possibly shrunk to len bytes
+//-------------------------------------------------------------------------
+void spsc_commit(SpscRing *ring, size_t len)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t idx = (head + ring->res_pad) & (ring->sz - 1);
+
+    if (len > ring->res_len)
+        len = ring->res_len;
+    ((SpscRecord *)(ring->data + idx))->len = (uint32_t)len;
+
+    head += ring->res_pad + SPSC_REC_HDR_LEN + SPSC_ALIGN(len);
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+}
+
+
+//-------------------------------------------------------------------------
+// Consumer: return the oldest record without removing it
+// Returns pointer to the record payload, NULL if the ring is empty
+//-------------------------------------------------------------------------
+void *spsc_peek(SpscRing *ring, size_t *len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail != head)
+    {
+        size_t idx = tail & (ring->sz - 1);
+        SpscRecord *rec = (SpscRecord *)(ring->data + idx);
+
+        if (rec->len == SPSC_PAD)
+        {
+            tail += ring->sz - idx;
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+            continue;
+        }
+
+        if (len != NULL)
+            *len = rec->len;
+        return ring->data + idx + SPSC_REC_HDR_LEN;
+    }
+    return NULL;
+}
+
+
+//-------------------------------------------------------------------------
+// Consumer: remove the record returned by the last spsc_peek()
+//-------------------------------------------------------------------------
+void spsc_release(SpscRing *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    SpscRecord *rec = (SpscRecord *)(ring->data + (tail & (ring->sz - 1)));
+
+    tail += SPSC_REC_HDR_LEN + SPSC_ALIGN(rec->len);
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+}
+
+
+//-------------------------------------------------------------------------
+// Check if ring is empty
+//-------------------------------------------------------------------------
+bool spsc_empty(SpscRing *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) ==
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+
+//-------------------------------------------------------------------------
+// Number of bytes in use, including record headers and padding
+//-------------------------------------------------------------------------
+size_t spsc_used(SpscRing *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+
+//-------------------------------------------------------------------------
+// Consumer of a shared ring: check that the ring fits in the len bytes
+// mapped and take its size and read position. The position must be a record
+// boundary, which is always 8-byte aligned.
+//-------------------------------------------------------------------------
+bool spsc_reader_init(SpscReader *rd, SpscRing *ring, size_t len)
+{
+    if (len < sizeof(SpscRing))
+        return false;
+
+    rd->ring = ring;
+    rd->sz = *(volatile size_t *)&ring->sz;
+    rd->tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    rd->len = 0;
+    return spsc_fits(rd->sz, len) && (rd->tail & 7) == 0;
+}
+
+
+//-------------------------------------------------------------------------
+// Consumer of a shared ring: find the oldest record.
+// Returns 1 and the record, 0 if the ring is empty, -1 if what the producer
+// wrote does not describe a record inside the ring.
+//-------------------------------------------------------------------------
+int spsc_reader_peek(SpscReader *rd, void **rec, size_t *len)
+{
+    for (;;)
+    {
+        size_t head = atomic_load_explicit(&rd->ring->head, memory_order_acquire);
+        size_t used = head - rd->tail;
+        if (used == 0)
+            return 0;
+        if (used > rd->sz || (head & 7) != 0)
+            return -1;
+
+        size_t idx = rd->tail & (rd->sz - 1);
+        if (idx + SPSC_REC_HDR_LEN > rd->sz)
+            return -1;
+
+        // Read once; the producer may change it after the checks
+        uint32_t n = atomic_load_explicit((_Atomic uint32_t *)(rd->ring->data + idx), memory_order_relaxed);
+        if (n == SPSC_PAD)
+        {
+            if (rd->sz - idx > used)
+                return -1;
+            rd->tail += rd->sz - idx;
+            atomic_store_explicit(&rd->ring->tail, rd->tail, memory_order_release);
+            continue;
+        }
+
+        size_t need = SPSC_REC_HDR_LEN + SPSC_ALIGN((size_t)n);
+        if (need > used || idx + need > rd->sz)
+            return -1;
+
+        rd->len = n;
+        *rec = rd->ring->data + idx + SPSC_REC_HDR_LEN;
+        if (len != NULL)
+            *len = n;
+        return 1;
+    }
+}
+
+
+//-------------------------------------------------------------------------
+// Consumer of a shared ring: remove the record returned by the last peek
+//-------------------------------------------------------------------------
+void spsc_reader_release(SpscReader *rd)
+{
+    rd->tail += SPSC_REC_HDR_LEN + SPSC_ALIGN(rd->len);
+    atomic_store_explicit(&rd->ring->tail, rd->tail, memory_order_release);
+}
+
+//#define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+#include <pthread.h>
+#include <sched.h>
+
+#define RING_SIZE		4096
+#define RECORDS			1000000
+
+static SpscRing *ring;
+
+//-------------------------------------------------------------------------
+//  Producer: records of varying length carrying a sequence number
+//-------------------------------------------------------------------------
+static void *producer(void *arg)
+{
+    (void)arg;
+    for (uint32_t i = 0; i < RECORDS; i++)
+    {
+        size_t len = sizeof(uint32_t) * (1 + i % 37);
+        uint32_t *rec;
+        while ((rec = spsc_reserve(ring, len)) == NULL)
+            sched_yield();
+        for (size_t k = 0; k < len / sizeof(uint32_t); k++)
+            rec[k] = i;
+        spsc_commit(ring, len);
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------------
+//  main()
+//-------------------------------------------------------------------------
+int main()
+{
+    pthread_t tid;
+    ring = spsc_create(RING_SIZE);
+    pthread_create(&tid, NULL, producer, NULL);
+
+    uint32_t expect = 0;
+    while (expect < RECORDS)
+    {
+        size_t len;
+        uint32_t *rec = spsc_peek(ring, &len);
+        if (rec == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+        if (len != sizeof(uint32_t) * (1 + expect % 37) || rec[0] != expect || rec[len/4-1] != expect)
+        {
+            printf("Mismatch at record %u\n", expect);
+            return -1;
+        }
+        spsc_release(ring);
+        expect++;
+    }
+    pthread_join(tid, NULL);
+    printf("%u records passed, ring empty=%d\n", expect, spsc_empty(ring));
+
+    // A reader must stay inside the ring whatever the producer writes
+    SpscReader rd;
+    size_t len;
+    void *rec;
+    spsc_reader_init(&rd, ring, sizeof(SpscRing) + ring->sz);
+    uint32_t *p = spsc_reserve(ring, 16);
+    spsc_commit(ring, 16);
+    p[-2] = (uint32_t)ring->sz;
+    ring->sz = 1 << 30;
+    if (spsc_reader_peek(&rd, &rec, &len) != -1)
+    {
+        printf("Oversized record accepted\n");
+        return -1;
+    }
+    p[-2] = 16;
+    if (spsc_reader_peek(&rd, &rec, &len) != 1 || len != 16)
+    {
+        printf("Record lost\n");
+        return -1;
+    }
+    spsc_reader_release(&rd);
+    printf("reader passed, ring empty=%d\n", spsc_empty(ring));
+
+    spsc_free(ring);
+    return 0;
+}
+#endif // UNIT_TEST
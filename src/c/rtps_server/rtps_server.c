@@ -30,44 +30,115 @@
 int main(int argc, char *argv[]) 
 {
    int rc = 0;
-   int port = 12345;
-   RTPS_Window plotwin = {0};
-   RTPS_Connection conn = {0};
+   const char *endpoint;
+   int fps = -1;
+   bool headless = false;
+   const char *dump_dir = NULL;
+   int dump_fps = 0;
+   RTPS_Connection conn = { .fd = -1, .client = -1, .udp_fd = -1 };
+   RTPS_Server server = {0};
 
 
    // Check usage 
    if (argc < 2)
    {
-      printf("Usage: rtps_server <port>\n");
+      printf("Usage: rtps_server <port|unix:path|unixpacket:path> [fps] "
+             "[-headless [dump_dir [dump_fps]]] [-latency]\n"
+             "       a dump_dir made only of digits is read as fps; write it as ./dir\n");
       return -1;
    }
-   else if (!RTPS_is_all_digits(argv[1]))
+   else if (!RTPS_is_all_digits(argv[1]) &&
+            strncmp(argv[1], "unix:", 5) != 0 && strncmp(argv[1], "unixpacket:", 11) != 0)
    {
-      printf("Error: <port> must be an integer.\n");
+      printf("Error: <port> must be an integer, or unix:path or unixpacket:path.\n");
       return -1;
    }
-   port = atoi(argv[1]);
+   endpoint = argv[1];
+
+   for (int i = 2; i < argc; i++)
+   {
+      if (0 == strcmp(argv[i], "-headless"))
+      {
+         headless = true;
+
+         // "-headless 30" sets the frame rate, not a directory named 30
+         if (i+1 < argc && argv[i+1][0] != '-' && !RTPS_is_all_digits(argv[i+1]))
+         {
+            dump_dir = argv[++i];
+            if (i+1 < argc && RTPS_is_all_digits(argv[i+1]))
+               dump_fps = atoi(argv[++i]);
+         }
+      }
+      else if (0 == strcmp(argv[i], "-latency"))
+      {
+         RTPS_server_set_latency_overlay(true);
+      }
+      else if (fps < 0 && RTPS_is_all_digits(argv[i]))
+      {
+         fps = atoi(argv[i]);
+      }
+      else
+      {
+         printf("Error: [fps] must be an integer, 0 for vsync.\n");
+         return -1;
+      }
+   }
 
 
-   // Init SDL
+   // Init SDL; headless needs no display
+   if (headless)
+      RTPS_server_set_headless(dump_dir, dump_fps);
    RTPS_server_init();
+   if (fps >= 0)
+      RTPS_server_set_frame_rate(fps);
 
 
-   // Wait for client connection
-   if (RTPS_wait_for_connection(&conn, port) < 0)
+   // Open the listener; clients are accepted by the ingest thread
+   if (RTPS_wait_for_endpoint(&conn, endpoint) < 0)
    {
       RTPS_perror("Wait for connection failed.");
       goto _err_ret;
    }
-   printf("Server listening on port %d.\n", port);
+   printf("Server listening on %s%s.\n", RTPS_is_all_digits(endpoint) ? "port " : "", endpoint);
 
 
+   // Receive and decode on a separate thread
+   if (RTPS_server_start(&server, &conn) < 0)
+   {
+      RTPS_perror("Ingest thread failed to start.");
+      goto _err_ret;
+   }
+
    while (!RTPS_server_forced_exit())
    {
-      RTPS_server_update(&conn, &plotwin);
+      RTPS_server_update(&server);
+      RTPS_server_render(&server);
    } 
+   RTPS_server_stop(&server);
+
+   if (headless && server.frames.count > 0)
+      printf("Rendered %llu frames: mean %.3f ms, max %.3f ms.\n",
+             (unsigned long long)server.frames.count,
+             server.frames.total_ns / 1e6 / server.frames.count,
+             server.frames.max_ns / 1e6);
+
+   // Latency of timestamped data, per window still open
+   for (int id = 0; id < MAX_WINDOWS; id++)
+   {
+      static const char *stage[RTPS_STAGES] = { "receive", "parse", "queue", "present" };
+      RTPS_LatencyStats st;
+
+      for (int s = 0; s < RTPS_STAGES; s++)
+      {
+         if (RTPS_server_get_latency(&server, id, s, &st) < 0 || st.count == 0) continue;
+         printf("Window %d %-7s %lu points: p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms.\n",
+                id, stage[s], st.count, st.p50_ns / 1e6, st.p99_ns / 1e6, st.p999_ns / 1e6,
+                st.max_ns / 1e6);
+      }
+   }
 
 _err_ret:
-   RTPS_server_shutdown(&plotwin);
+   RTPS_disconnect(&conn);
+   RTPS_server_shutdown(&server);
    return rc;
 }